@@ -0,0 +1,28 @@
+#include "benchmark.h"
+#include "ecs_benchmark.h"
+
+#include <cstdio>
+
+namespace benchmark
+{
+	volatile float sink = 0.0f;
+
+	int run()
+	{
+		runEcsBenchmarks();
+		return 0;
+	}
+
+	void printHeader(const std::string& title, const std::string& baseline, const std::string& contender)
+	{
+		std::printf("\n### %s\n\n", title.c_str());
+		std::printf("| Benchmark | %s (us) | %s (us) | Speedup |\n", baseline.c_str(), contender.c_str());
+		std::printf("| --------- | ---: | ---: | ---: |\n");
+	}
+
+	void printRow(const std::string& name, double baseline_us, double contender_us)
+	{
+		std::printf("| %s | %.1f | %.1f | %.2fx |\n", name.c_str(), baseline_us, contender_us,
+		            baseline_us / contender_us);
+	}
+}
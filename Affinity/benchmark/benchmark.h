@@ -0,0 +1,57 @@
+#pragma once
+#include <chrono>
+#include <string>
+
+/*
+ * Headless benchmarks, run with the --benchmark command line argument.
+ * Results are printed as markdown tables so they can be pasted into the README.
+ */
+namespace benchmark
+{
+	/**
+	 * \brief Run every benchmark
+	 * \return Exit code
+	 */
+	int run();
+
+	/**
+	 * \brief Time a function
+	 * \param runs How many times to run the function
+	 * \param func Function to time
+	 * \return Average time of one run in microseconds
+	 */
+	template <typename Func>
+	double measure(int runs, Func&& func)
+	{
+		// Warm up caches and let pools reach their steady state size
+		func();
+
+		const auto start = std::chrono::high_resolution_clock::now();
+		for (auto i = 0; i < runs; ++i)
+		{
+			func();
+		}
+		const auto end = std::chrono::high_resolution_clock::now();
+
+		return std::chrono::duration<double, std::micro>(end - start).count() / runs;
+	}
+
+	/**
+	 * \brief Print the header of a result table
+	 * \param title Title of the table
+	 * \param baseline Name of the baseline column
+	 * \param contender Name of the compared column
+	 */
+	void printHeader(const std::string& title, const std::string& baseline, const std::string& contender);
+
+	/**
+	 * \brief Print a row of a result table
+	 * \param name Name of the benchmark
+	 * \param baseline_us Time of the baseline in microseconds
+	 * \param contender_us Time of the contender in microseconds
+	 */
+	void printRow(const std::string& name, double baseline_us, double contender_us);
+
+	// Prevents the optimizer from removing benchmarked work
+	extern volatile float sink;
+}
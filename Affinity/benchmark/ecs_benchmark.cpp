@@ -0,0 +1,1098 @@
+#include "ecs_benchmark.h"
+#include "benchmark.h"
+#include "../engine/ecs/components.h"
+#include "../engine/ecs/component_ref.h"
+#include "../engine/ecs/prefab.h"
+#include "../engine/ecs/static_ecs.h"
+#include "../engine/ecs/sweep_batch.h"
+#include "../engine/ecs/systems/boat_system.h"
+#include "../engine/ecs/systems/particle_system.h"
+#include "../engine/ecs/systems/physics_system.h"
+#include "../engine/ecs/systems/sprite_render_system.h"
+
+#include <glm/gtx/hash.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace
+{
+	constexpr auto NUM_BOATS       = 10000;
+	constexpr auto NUM_CANNONBALLS = 500;
+	constexpr auto NUM_PARTICLES   = 200;
+	constexpr auto CHURN_ENTITIES  = 1000;
+	constexpr auto SPAWN_BOATS     = 1000000;
+	constexpr auto AIMED_BALLS     = 2000;
+	constexpr auto NEAREST_ENEMIES = 8;
+
+	constexpr auto NUM_PARALLEL_PARTICLES = 100000;
+
+	// The components of the boat scene known at compile time
+	using StaticBoatScene = StaticEntityComponentSystem<Transform, Sprite, Camera, Script, Boat, BoatAi, Cannonball,
+	                                                    Particle>;
+
+	static_assert(StaticBoatScene::canRunSystem<BoatSystem>() && StaticBoatScene::canRunSystem<PhysicsSystem>() &&
+	              StaticBoatScene::canRunSystem<ParticleSystem>() &&
+	              StaticBoatScene::canRunSystem<SpriteRenderSystem>(),
+	              "The static boat scene is missing a component a system accesses");
+
+	void registerComponents(EntityComponentSystem& ecs)
+	{
+		ecs.registerComponent<Transform>();
+		ecs.registerComponent<Sprite>();
+		ecs.registerComponent<Camera>(ComponentStorageEnum::SPARSE_SET);
+		ecs.registerComponent<Script>(ComponentStorageEnum::SPARSE_SET);
+		ecs.registerComponent<Boat>();
+		ecs.registerComponent<BoatAi>();
+		ecs.registerComponent<Cannonball>();
+		ecs.registerComponent<Particle>(ComponentStorageEnum::SPARSE_SET);
+	}
+
+	// Same components as Engine::initEcs registers, with the boats' components in an owning group
+	void registerGroupedComponents(EntityComponentSystem& ecs)
+	{
+		ecs.registerComponent<Transform>(ComponentStorageEnum::SPARSE_SET);
+		ecs.registerComponent<Sprite>();
+		ecs.registerComponent<Camera>(ComponentStorageEnum::SPARSE_SET);
+		ecs.registerComponent<Script>(ComponentStorageEnum::SPARSE_SET);
+		ecs.registerComponent<Boat>(ComponentStorageEnum::SPARSE_SET);
+		ecs.registerComponent<BoatAi>(ComponentStorageEnum::SPARSE_SET);
+		ecs.registerComponent<Cannonball>(ComponentStorageEnum::SPARSE_SET);
+		ecs.registerComponent<Particle>(ComponentStorageEnum::SPARSE_SET);
+		ecs.addGroup<Transform, Boat, BoatAi>();
+	}
+
+	// Roughly the scene created by Game::init in the middle of a battle
+	std::vector<Entity> populate(EntityComponentSystem& ecs)
+	{
+		std::srand(0);
+		std::vector<Entity> boats;
+
+		auto camera = ecs.createEntity();
+		camera.setComponent<Transform>();
+		camera.setComponent<Camera>();
+		camera.setComponent<Script>();
+
+		for (auto i = 0; i < NUM_BOATS; ++i)
+		{
+			auto e = ecs.createEntity();
+			e.setTag("boat");
+			e.setComponent<Transform>(Transform(glm::vec2(std::rand() % 2000, std::rand() % 2000) * 10.0f,
+			                                    static_cast<float>(i), glm::vec2(113, 66)));
+			e.setComponent<Sprite>();
+			e.setComponent<Boat>(Boat(static_cast<Boat::BoatTeamEnum>(i % 2 + 1)));
+			e.setComponent<BoatAi>();
+			boats.push_back(e);
+		}
+
+		for (auto i = 0; i < NUM_CANNONBALLS; ++i)
+		{
+			auto e = ecs.createEntity();
+			e.setComponent<Transform>(Transform(glm::vec2(static_cast<float>(i)), 0, glm::vec2(10)));
+			e.setComponent<Sprite>();
+			e.setComponent<Cannonball>(Cannonball(glm::vec2(1, 0), 30));
+		}
+
+		for (auto i = 0; i < NUM_PARTICLES; ++i)
+		{
+			auto e = ecs.createEntity();
+			e.setComponent<Transform>();
+			e.setComponent<Sprite>();
+			e.setComponent<Particle>(Particle(60, 60));
+		}
+
+		return boats;
+	}
+
+	// Same scene as populate
+	std::vector<StaticEntity> populate(StaticBoatScene& ecs)
+	{
+		std::srand(0);
+		std::vector<StaticEntity> boats;
+
+		const auto camera = ecs.createEntity();
+		ecs.setComponent<Transform>(camera);
+		ecs.setComponent<Camera>(camera);
+		ecs.setComponent<Script>(camera);
+
+		for (auto i = 0; i < NUM_BOATS; ++i)
+		{
+			const auto e = ecs.createEntity();
+			ecs.setComponent<Transform>(e, Transform(glm::vec2(std::rand() % 2000, std::rand() % 2000) * 10.0f,
+			                                         static_cast<float>(i), glm::vec2(113, 66)));
+			ecs.setComponent<Sprite>(e);
+			ecs.setComponent<Boat>(e, Boat(static_cast<Boat::BoatTeamEnum>(i % 2 + 1)));
+			ecs.setComponent<BoatAi>(e);
+			boats.push_back(e);
+		}
+
+		for (auto i = 0; i < NUM_CANNONBALLS; ++i)
+		{
+			const auto e = ecs.createEntity();
+			ecs.setComponent<Transform>(e, Transform(glm::vec2(static_cast<float>(i)), 0, glm::vec2(10)));
+			ecs.setComponent<Sprite>(e);
+			ecs.setComponent<Cannonball>(e, Cannonball(glm::vec2(1, 0), 30));
+		}
+
+		for (auto i = 0; i < NUM_PARTICLES; ++i)
+		{
+			const auto e = ecs.createEntity();
+			ecs.setComponent<Transform>(e);
+			ecs.setComponent<Sprite>(e);
+			ecs.setComponent<Particle>(e, Particle(60, 60));
+		}
+
+		return boats;
+	}
+
+	// The per boat work of BoatSystem without the AI
+	void updateBoat(Transform& t, Boat& b)
+	{
+		b.cooldownRemaining = glm::max(0.0f, b.cooldownRemaining - 1.0f);
+		t.position += glm::vec2(cos(t.rotation), sin(t.rotation)) * b.speed;
+	}
+
+	double iterateBoats(EntityComponentSystem& ecs)
+	{
+		if (const auto archetypes = ecs.getArchetypeStorage())
+		{
+			return benchmark::measure(200, [&]
+			{
+				archetypes->each<Transform, Boat, BoatAi>([&](uint32_t, Transform& t, Boat& b, BoatAi&)
+				{
+					updateBoat(t, b);
+				});
+			});
+		}
+
+		return benchmark::measure(200, [&]
+		{
+			const auto tView  = ecs.getComponentView<Transform>();
+			const auto bView  = ecs.getComponentView<Boat>();
+			const auto aiView = ecs.getComponentView<BoatAi>();
+			ecs.entityLoop([&](uint32_t i)
+			{
+				const auto t = tView.get(i);
+				const auto b = bView.get(i);
+				if (t && b && aiView.has(i))
+				{
+					updateBoat(*t, *b);
+				}
+			});
+		});
+	}
+
+	double iterateSprites(EntityComponentSystem& ecs)
+	{
+		if (const auto archetypes = ecs.getArchetypeStorage())
+		{
+			return benchmark::measure(200, [&]
+			{
+				auto sum = 0.0f;
+				archetypes->each<Transform, Sprite>([&](uint32_t, Transform& t, Sprite& s)
+				{
+					sum += t.position.x * s.color.a;
+				});
+				benchmark::sink = sum;
+			});
+		}
+
+		return benchmark::measure(200, [&]
+		{
+			const auto tView = ecs.getComponentView<Transform>();
+			const auto sView = ecs.getComponentView<Sprite>();
+			auto sum         = 0.0f;
+			ecs.entityLoop([&](uint32_t i)
+			{
+				const auto t = tView.get(i);
+				const auto s = sView.get(i);
+				if (t && s)
+				{
+					sum += t->position.x * s->color.a;
+				}
+			});
+			benchmark::sink = sum;
+		});
+	}
+
+	// Look up components through entity handles like the boat AI does for its target
+	double handleAccess(std::vector<Entity>& boats)
+	{
+		return benchmark::measure(200, [&]
+		{
+			auto sum = 0.0f;
+			for (auto& boat : boats)
+			{
+				const auto t  = boat.getComponent<Transform>();
+				const auto b  = boat.getComponent<Boat>();
+				const auto ai = boat.getComponent<BoatAi>();
+				if (t && b && ai)
+				{
+					sum += t->position.x + b->speed;
+				}
+			}
+			benchmark::sink = sum;
+		});
+	}
+
+	// Same as handleAccess through handles that keep the looked up components
+	double refAccess(std::vector<Entity>& boats)
+	{
+		struct Refs
+		{
+			ComponentRef<const Transform> t;
+			ComponentRef<const Boat> b;
+			ComponentRef<const BoatAi> ai;
+		};
+
+		std::vector<Refs> refs;
+		for (const auto& boat : boats)
+		{
+			refs.push_back({ComponentRef<const Transform>(boat), ComponentRef<const Boat>(boat),
+			                ComponentRef<const BoatAi>(boat)});
+		}
+
+		return benchmark::measure(200, [&]
+		{
+			auto sum = 0.0f;
+			for (auto& ref : refs)
+			{
+				const auto t  = ref.t.get();
+				const auto b  = ref.b.get();
+				const auto ai = ref.ai.get();
+				if (t && b && ai)
+				{
+					sum += t->position.x + b->speed;
+				}
+			}
+			benchmark::sink = sum;
+		});
+	}
+
+	// Add and remove a component on every boat, which moves every boat between archetypes twice
+	double structuralChanges(std::vector<Entity>& boats)
+	{
+		return benchmark::measure(20, [&]
+		{
+			for (auto& boat : boats)
+			{
+				boat.setComponent<Particle>(Particle(1, 1));
+			}
+			for (auto& boat : boats)
+			{
+				boat.removeComponent<Particle>();
+			}
+		});
+	}
+
+	// Spawn and destroy cannonball-like entities like the AI does while fighting
+	double churn(EntityComponentSystem& ecs)
+	{
+		std::vector<Entity> spawned;
+		spawned.reserve(CHURN_ENTITIES);
+
+		return benchmark::measure(50, [&]
+		{
+			for (auto i = 0; i < CHURN_ENTITIES; ++i)
+			{
+				auto e = ecs.createEntity();
+				e.setComponent<Transform>(Transform(glm::vec2(static_cast<float>(i)), 0, glm::vec2(10)));
+				e.setComponent<Sprite>();
+				e.setComponent<Cannonball>(Cannonball(glm::vec2(1, 0), 30));
+				spawned.push_back(e);
+			}
+			for (auto& e : spawned)
+			{
+				e.destroy();
+			}
+			spawned.clear();
+		});
+	}
+
+	// The embarrassingly parallel work of BoatSystem, ParticleSystem and SpriteRenderSystem
+	void cooldown(Boat& b)
+	{
+		b.cooldownRemaining = glm::max(0.0f, b.cooldownRemaining - 1.0f);
+	}
+
+	void fade(Particle& p, Sprite& s)
+	{
+		p.lifetime = p.lifetime > 1.0f ? p.lifetime - 1.0f : p.fadetime;
+		s.color.a  = glm::clamp(p.lifetime / p.fadetime, 0.0f, 1.0f);
+	}
+
+	bool isVisible(const Transform& t)
+	{
+		const auto box = glm::vec4(t.position - t.scale, t.position + t.scale);
+		return !(box.z < 0 || box.w < 0 || box.x > 10000 || box.y > 10000);
+	}
+
+	void runStaticBenchmarks()
+	{
+		EntityComponentSystem ecs;
+		registerComponents(ecs);
+		auto boats = populate(ecs);
+
+		StaticBoatScene staticEcs;
+		auto staticBoats = populate(staticEcs);
+
+		const auto dynamicIterate = benchmark::measure(200, [&]
+		{
+			ecs.each<Transform, Boat, BoatAi>([](uint32_t, Transform& t, Boat& b, BoatAi&) { updateBoat(t, b); });
+		});
+		const auto staticIterate = benchmark::measure(200, [&]
+		{
+			staticEcs.each<Transform, Boat, BoatAi>([](uint32_t, Transform& t, Boat& b, BoatAi&)
+			{
+				updateBoat(t, b);
+			});
+		});
+
+		const auto dynamicAccess = handleAccess(boats);
+		const auto staticAccess  = benchmark::measure(200, [&]
+		{
+			auto sum = 0.0f;
+			for (const auto boat : staticBoats)
+			{
+				const auto t  = staticEcs.getComponent<Transform>(boat);
+				const auto b  = staticEcs.getComponent<Boat>(boat);
+				const auto ai = staticEcs.getComponent<BoatAi>(boat);
+				if (t && b && ai)
+				{
+					sum += t->position.x + b->speed;
+				}
+			}
+			benchmark::sink = sum;
+		});
+
+		const auto dynamicChurn = churn(ecs);
+		std::vector<StaticEntity> spawned;
+		spawned.reserve(CHURN_ENTITIES);
+		const auto staticChurn = benchmark::measure(50, [&]
+		{
+			for (auto i = 0; i < CHURN_ENTITIES; ++i)
+			{
+				const auto e = staticEcs.createEntity();
+				staticEcs.setComponent<Transform>(e, Transform(glm::vec2(static_cast<float>(i)), 0, glm::vec2(10)));
+				staticEcs.setComponent<Sprite>(e);
+				staticEcs.setComponent<Cannonball>(e, Cannonball(glm::vec2(1, 0), 30));
+				spawned.push_back(e);
+			}
+			for (const auto e : spawned)
+			{
+				staticEcs.destroyEntity(e);
+			}
+			spawned.clear();
+		});
+
+		benchmark::printHeader("Runtime and compile time component lists (boat scene)", "EntityComponentSystem",
+		                       "StaticEntityComponentSystem");
+		benchmark::printRow("Iterate Transform+Boat+BoatAi (10k boats)", dynamicIterate, staticIterate);
+		benchmark::printRow("getComponent x3 through 10k handles", dynamicAccess, staticAccess);
+		benchmark::printRow("Create+destroy 1k cannonballs", dynamicChurn, staticChurn);
+	}
+
+	void runParallelBenchmarks()
+	{
+		EntityComponentSystem ecs;
+		registerComponents(ecs);
+		populate(ecs);
+
+		for (auto i = 0; i < NUM_PARALLEL_PARTICLES; ++i)
+		{
+			auto e = ecs.createEntity();
+			e.setComponent<Transform>(Transform(glm::vec2(std::rand() % 2000, std::rand() % 2000) * 10.0f));
+			e.setComponent<Sprite>();
+			e.setComponent<Particle>(Particle(static_cast<float>(i % 60 + 1), 60));
+		}
+
+		const auto sequentialCooldowns = benchmark::measure(200, [&]
+		{
+			ecs.each<Boat>([](uint32_t, Boat& b) { cooldown(b); });
+		});
+		const auto parallelCooldowns = benchmark::measure(200, [&]
+		{
+			ecs.parallelEach<Boat>([](uint32_t, Boat& b) { cooldown(b); });
+		});
+
+		const auto sequentialFade = benchmark::measure(200, [&]
+		{
+			ecs.each<Particle, Sprite>([](uint32_t, Particle& p, Sprite& s) { fade(p, s); });
+		});
+		const auto parallelFade = benchmark::measure(200, [&]
+		{
+			ecs.parallelEach<Particle, Sprite>([](uint32_t, Particle& p, Sprite& s) { fade(p, s); });
+		});
+
+		const auto sequentialCulling = benchmark::measure(200, [&]
+		{
+			auto visible = 0u;
+			ecs.each<const Transform, const Sprite>([&](uint32_t, const Transform& t, const Sprite&)
+			{
+				visible += isVisible(t);
+			});
+			benchmark::sink = static_cast<float>(visible);
+		});
+		const auto parallelCulling = benchmark::measure(200, [&]
+		{
+			benchmark::sink = static_cast<float>(ecs.parallelReduce<const Transform, const Sprite>(
+				0u,
+				[](uint32_t& visible, uint32_t, const Transform& t, const Sprite&) { visible += isVisible(t); },
+				[](uint32_t lhs, uint32_t rhs) { return lhs + rhs; }));
+		});
+
+		benchmark::printHeader("Parallel loops (" + std::to_string(ecs.getThreadPool().getNumThreads()) + " threads)",
+		                       "each", "parallelEach");
+		benchmark::printRow("Boat cooldowns (10k boats)", sequentialCooldowns, parallelCooldowns);
+		benchmark::printRow("Particle fade (100k particles)", sequentialFade, parallelFade);
+		benchmark::printRow("Sprite culling (110k sprites)", sequentialCulling, parallelCulling);
+	}
+
+	void runGroupBenchmarks()
+	{
+		EntityComponentSystem dense;
+		registerComponents(dense);
+		populate(dense);
+
+		EntityComponentSystem grouped;
+		registerGroupedComponents(grouped);
+		populate(grouped);
+
+		const auto iterate = [](EntityComponentSystem& ecs)
+		{
+			return benchmark::measure(200, [&]
+			{
+				ecs.each<Transform, Boat, BoatAi>([](uint32_t, Transform& t, Boat& b, BoatAi&) { updateBoat(t, b); });
+			});
+		};
+		const auto cull = [](EntityComponentSystem& ecs)
+		{
+			return benchmark::measure(200, [&]
+			{
+				auto visible = 0u;
+				ecs.each<const Transform, const Sprite>([&](uint32_t, const Transform& t, const Sprite&)
+				{
+					visible += isVisible(t);
+				});
+				benchmark::sink = static_cast<float>(visible);
+			});
+		};
+
+		const auto denseIterate   = iterate(dense);
+		const auto groupedIterate = iterate(grouped);
+		const auto denseCull      = cull(dense);
+		const auto groupedCull    = cull(grouped);
+		const auto denseChurn     = churn(dense);
+		const auto groupedChurn   = churn(grouped);
+
+		benchmark::printHeader("Owning group of Transform+Boat+BoatAi (boat scene)", "Dense pools", "Owning group");
+		benchmark::printRow("Iterate Transform+Boat+BoatAi (10k boats)", denseIterate, groupedIterate);
+		benchmark::printRow("Sprite culling (10.7k sprites)", denseCull, groupedCull);
+		benchmark::printRow("Create+destroy 1k cannonballs", denseChurn, groupedChurn);
+	}
+
+	// Create a fleet into an empty ECS one entity at a time or in one batch from a prefab
+	double spawnBoats(StorageBackendEnum backend, bool batched)
+	{
+		return benchmark::measure(3, [&]
+		{
+			EntityComponentSystem ecs(backend);
+			registerComponents(ecs);
+
+			if (batched)
+			{
+				Prefab boat;
+				boat.setComponent<Transform>(Transform(glm::vec2(0), 0, glm::vec2(113, 66)))
+				    .setComponent<Sprite>()
+				    .setComponent<Boat>()
+				    .setComponent<BoatAi>();
+				benchmark::sink = static_cast<float>(ecs.createEntities(SPAWN_BOATS, boat).size());
+				return;
+			}
+
+			for (auto i = 0; i < SPAWN_BOATS; ++i)
+			{
+				auto e = ecs.createEntity();
+				e.setComponent<Transform>(Transform(glm::vec2(0), 0, glm::vec2(113, 66)));
+				e.setComponent<Sprite>();
+				e.setComponent<Boat>();
+				e.setComponent<BoatAi>();
+			}
+			benchmark::sink = static_cast<float>(ecs.getNumEntities());
+		});
+	}
+
+	void runSpawnBenchmarks()
+	{
+		const auto poolsSingle      = spawnBoats(StorageBackendEnum::COMPONENT_POOLS, false);
+		const auto poolsBatched     = spawnBoats(StorageBackendEnum::COMPONENT_POOLS, true);
+		const auto archetypeSingle  = spawnBoats(StorageBackendEnum::ARCHETYPES, false);
+		const auto archetypeBatched = spawnBoats(StorageBackendEnum::ARCHETYPES, true);
+
+		benchmark::printHeader("Spawning boats", "createEntity + setComponent", "createEntities(prefab)");
+		benchmark::printRow("Spawn 1M boats (component pools)", poolsSingle, poolsBatched);
+		benchmark::printRow("Spawn 1M boats (archetypes)", archetypeSingle, archetypeBatched);
+	}
+
+	// Cannonball test of PhysicsSystem: the ball's box against the boat's box, in the boat's coordinates
+	bool hitsBoat(const Transform& ball, const Transform& boat)
+	{
+		const auto boatBox         = glm::vec4(-boat.scale, boat.scale);
+		const auto relativeBallPos = ball.position - boat.position;
+		const auto c               = cos(-boat.rotation);
+		const auto s               = sin(-boat.rotation);
+		const auto rotatedBallBox  = glm::vec4(
+			glm::vec2(relativeBallPos.x * c - relativeBallPos.y * s,
+			          relativeBallPos.x * s + relativeBallPos.y * c) - ball.scale,
+			ball.scale);
+
+		return !(rotatedBallBox.x < boatBox.x || rotatedBallBox.y < boatBox.y ||
+		         rotatedBallBox.x > boatBox.x + boatBox.z || rotatedBallBox.y > boatBox.y + boatBox.w);
+	}
+
+	// Every boat drifts a little each frame, so the broadphase has to follow them
+	void driftBoats(EntityComponentSystem& ecs, int frame)
+	{
+		const auto step = frame % 2 == 0 ? 5.0f : -5.0f;
+		ecs.each<Transform, Boat>([&](uint32_t, Transform& t, Boat&)
+		{
+			t.position += glm::vec2(cos(t.rotation), sin(t.rotation)) * step;
+		});
+	}
+
+	// The per frame grid PhysicsSystem used to build, which only tested boats in the cannonball's own cell
+	uint32_t chunkMapHits(EntityComponentSystem& ecs,
+	                      std::unordered_map<glm::ivec2, std::vector<const Transform*>>& cannonball_grid,
+	                      std::unordered_map<glm::ivec2, std::vector<const Transform*>>& boat_grid)
+	{
+		constexpr auto CHUNK_SIZE = 1000.0f;
+
+		for (auto& cell : cannonball_grid)
+		{
+			cell.second.clear();
+		}
+		for (auto& cell : boat_grid)
+		{
+			cell.second.clear();
+		}
+		ecs.each<const Transform, const Cannonball>([&](uint32_t, const Transform& t, const Cannonball&)
+		{
+			cannonball_grid[glm::ivec2(floor(t.position / CHUNK_SIZE))].push_back(&t);
+		});
+		ecs.each<const Transform, const Boat, Without<Cannonball>>([&](uint32_t, const Transform& t, const Boat&)
+		{
+			boat_grid[glm::ivec2(floor(t.position / CHUNK_SIZE))].push_back(&t);
+		});
+
+		auto hits = 0u;
+		for (const auto& cell : cannonball_grid)
+		{
+			for (const auto ball : cell.second)
+			{
+				for (const auto boat : boat_grid[cell.first])
+				{
+					hits += hitsBoat(*ball, *boat);
+				}
+			}
+		}
+		return hits;
+	}
+
+	// The broadphase of PhysicsSystem, every boat binned into a flat grid each frame
+	uint32_t spatialIndexHits(EntityComponentSystem& ecs, SpatialIndex& boat_index)
+	{
+		boat_index.clear();
+		ecs.each<const Transform, const Boat, Without<Cannonball>>([&](uint32_t i, const Transform& t, const Boat&)
+		{
+			boat_index.insert(i, t.position, glm::length(t.scale));
+		});
+		boat_index.build();
+
+		auto hits = 0u;
+		ecs.each<const Transform, const Cannonball>([&](uint32_t, const Transform& ball, const Cannonball&)
+		{
+			boat_index.queryAabb(ball.position - ball.scale, ball.position + ball.scale, [&](uint32_t i)
+			{
+				hits += hitsBoat(ball, *ecs.getEntityByIdx(i).getComponent<const Transform>());
+			});
+		});
+		return hits;
+	}
+
+	void runBroadphaseBenchmarks()
+	{
+		EntityComponentSystem ecs;
+		registerComponents(ecs);
+		auto boats = populate(ecs);
+
+		// Cannonballs around random boats, many of them across a cell border from the boat they hit
+		for (auto i = 0; i < AIMED_BALLS; ++i)
+		{
+			const auto target = boats[std::rand() % boats.size()].getComponent<const Transform>()->position;
+			auto e            = ecs.createEntity();
+			e.setComponent<Transform>(Transform(target + glm::vec2(std::rand() % 200 - 100, std::rand() % 200 - 100),
+			                                    0, glm::vec2(10)));
+			e.setComponent<Cannonball>(Cannonball(glm::vec2(1, 0), 30));
+		}
+
+		std::unordered_map<glm::ivec2, std::vector<const Transform*>> cannonballGrid;
+		std::unordered_map<glm::ivec2, std::vector<const Transform*>> boatGrid;
+		SpatialIndex boatIndex;
+		auto frame         = 0;
+		auto chunkMapFound = 0u;
+		auto indexFound    = 0u;
+		const auto chunkMap = benchmark::measure(200, [&]
+		{
+			driftBoats(ecs, frame++);
+			chunkMapFound = chunkMapHits(ecs, cannonballGrid, boatGrid);
+		});
+		const auto index = benchmark::measure(200, [&]
+		{
+			driftBoats(ecs, frame++);
+			indexFound = spatialIndexHits(ecs, boatIndex);
+		});
+
+		benchmark::printHeader("Cannonball broadphase", "Per frame chunk maps", "Flat grid");
+		benchmark::printRow("Move 10k boats + collide 2.5k cannonballs", chunkMap, index);
+		std::printf("\nHits found: %u with chunk maps, %u with the flat grid\n", chunkMapFound, indexFound);
+	}
+
+	struct Shot final
+	{
+		Transform transform;
+		Cannonball cannonball;
+	};
+
+	// Cannonballs fired from a few boat lengths away at random boats
+	std::vector<Shot> aimShots(std::vector<Entity>& boats)
+	{
+		std::vector<Shot> shots;
+		for (auto i = 0; i < AIMED_BALLS; ++i)
+		{
+			const auto target = boats[std::rand() % boats.size()].getComponent<const Transform>()->position;
+			const auto angle  = static_cast<float>(std::rand() % 360) * glm::pi<float>() / 180.0f;
+			const auto from   = glm::vec2(cos(angle), sin(angle));
+			shots.push_back({Transform(target + from * 300.0f, 0, glm::vec2(10)), Cannonball(-from, 30)});
+		}
+		return shots;
+	}
+
+	// Steps every shot until it hits a boat or falls into the water, either moving it and testing where it lands
+	// like PhysicsSystem used to or sweeping it along its path
+	uint32_t fireShots(EntityComponentSystem& ecs, const SpatialIndex& boat_index, std::vector<Shot> shots,
+	                   float delta, bool swept)
+	{
+		auto hits = 0u;
+		while (!shots.empty())
+		{
+			for (size_t i = shots.size(); i-- > 0;)
+			{
+				auto& transform  = shots[i].transform;
+				auto& cannonball = shots[i].cannonball;
+
+				auto distance = cannonball.speed * delta;
+				if (swept)
+				{
+					distance = cannonball.speed > delta
+						? (cannonball.speed - delta * 0.5f) * delta
+						: cannonball.speed * cannonball.speed * 0.5f;
+				}
+				const auto start = transform.position;
+				const auto end   = start + cannonball.direction * distance;
+				transform.position = end;
+				cannonball.speed -= delta;
+
+				auto hit = false;
+				const auto queryMin = swept ? glm::min(start, end) : end;
+				const auto queryMax = swept ? glm::max(start, end) : end;
+				boat_index.queryAabb(queryMin - transform.scale, queryMax + transform.scale, [&](uint32_t b)
+				{
+					const auto& boat = *ecs.getEntityByIdx(b).getComponent<const Transform>();
+					hit = hit || (swept ? PhysicsSystem::sweepCannonball(start, end, transform.scale, boat) <= 1.0f
+					                    : hitsBoat(transform, boat));
+				});
+
+				if (hit || cannonball.speed <= 0)
+				{
+					hits += hit;
+					shots[i] = shots.back();
+					shots.pop_back();
+				}
+			}
+		}
+		return hits;
+	}
+
+	void runTimestepBenchmarks()
+	{
+		EntityComponentSystem ecs;
+		registerComponents(ecs);
+		auto boats       = populate(ecs);
+		const auto shots = aimShots(boats);
+
+		SpatialIndex boatIndex;
+		ecs.each<const Transform, const Boat, Without<Cannonball>>([&](uint32_t i, const Transform& t, const Boat&)
+		{
+			boatIndex.insert(i, t.position, glm::length(t.scale));
+		});
+		boatIndex.build();
+
+		// The frame timer's delta counts 60 Hz frames, so 15 Hz updates are 4 frames long
+		std::array<uint32_t, 4> hits = {};
+		const auto point60 = benchmark::measure(20, [&] { hits[0] = fireShots(ecs, boatIndex, shots, 1.0f, false); });
+		const auto point15 = benchmark::measure(20, [&] { hits[1] = fireShots(ecs, boatIndex, shots, 4.0f, false); });
+		const auto swept60 = benchmark::measure(20, [&] { hits[2] = fireShots(ecs, boatIndex, shots, 1.0f, true); });
+		const auto swept15 = benchmark::measure(20, [&] { hits[3] = fireShots(ecs, boatIndex, shots, 4.0f, true); });
+
+		benchmark::printHeader("Cannonball timestep", "Point test", "Swept test");
+		benchmark::printRow("Fire 2k cannonballs, 60 Hz updates", point60, swept60);
+		benchmark::printRow("Fire 2k cannonballs, 15 Hz updates", point15, swept15);
+		std::printf("\nHits at 60 Hz / 15 Hz: %u / %u with the point test, %u / %u with the swept test\n", hits[0],
+		            hits[1], hits[2], hits[3]);
+	}
+
+	struct SweepPair final
+	{
+		glm::vec2 start;
+		glm::vec2 end;
+		glm::vec2 ballScale;
+		const Transform* boat;
+	};
+
+	// Every step of every shot at 15 Hz paired with the boats the broadphase finds for it, added to the batch in
+	// the same order
+	std::vector<SweepPair> gatherSweeps(EntityComponentSystem& ecs, const SpatialIndex& boat_index,
+	                                    std::vector<Shot> shots, SweepBatch& batch)
+	{
+		std::vector<SweepPair> pairs;
+		for (auto& shot : shots)
+		{
+			for (auto& ball = shot.cannonball; ball.speed > 0; ball.speed -= 4.0f)
+			{
+				const auto start = shot.transform.position;
+				const auto end   = start + ball.direction * ball.speed * 4.0f;
+				shot.transform.position = end;
+
+				const auto scale = shot.transform.scale;
+				boat_index.queryAabb(glm::min(start, end) - scale, glm::max(start, end) + scale, [&](uint32_t b)
+				{
+					const auto boat = ecs.getEntityByIdx(b).getComponent<const Transform>();
+					pairs.push_back({start, end, scale, boat});
+					batch.add(start, end, boat->position, PhysicsSystem::getSweepRotation(boat->rotation),
+						scale - boat->scale, scale);
+				});
+			}
+		}
+		return pairs;
+	}
+
+	void runNarrowphaseBenchmarks()
+	{
+		EntityComponentSystem ecs;
+		registerComponents(ecs);
+		auto boats       = populate(ecs);
+		const auto shots = aimShots(boats);
+
+		SpatialIndex boatIndex;
+		ecs.each<const Transform, const Boat, Without<Cannonball>>([&](uint32_t i, const Transform& t, const Boat&)
+		{
+			boatIndex.insert(i, t.position, glm::length(t.scale));
+		});
+		boatIndex.build();
+
+		SweepBatch batch;
+		const auto pairs = gatherSweeps(ecs, boatIndex, shots, batch);
+
+		// What PhysicsSystem did before the batch, one pair at a time with the boat's rotation computed every time
+		auto perPairHits = 0u;
+		const auto perPair = benchmark::measure(100, [&]
+		{
+			perPairHits = 0;
+			for (const auto& pair : pairs)
+			{
+				const auto t = PhysicsSystem::sweepCannonball(pair.start, pair.end, pair.ballScale, *pair.boat);
+				perPairHits += t <= 1.0f;
+			}
+		});
+
+		// Every kernel has to give the scalar kernel's results exactly
+		batch.run(SweepBatch::KernelEnum::SCALAR);
+		std::vector<float> expected(batch.size());
+		for (uint32_t i = 0; i < batch.size(); ++i)
+		{
+			expected[i] = batch.getResult(i);
+		}
+
+		const auto name = "Sweep " + std::to_string(pairs.size()) + " cannonball-boat pairs, ";
+		benchmark::printHeader("Cannonball narrowphase", "Scalar per pair", "Batched");
+
+		const std::pair<SweepBatch::KernelEnum, const char*> kernels[] = {
+			{SweepBatch::KernelEnum::SCALAR, "scalar"},
+			{SweepBatch::KernelEnum::SSE, "SSE"},
+			{SweepBatch::KernelEnum::AVX2, "AVX2"}
+		};
+		std::string results;
+		for (const auto& kernel : kernels)
+		{
+			if (kernel.first > SweepBatch::getBestKernel())
+			{
+				std::printf("| %s%s kernel | not supported | | |\n", name.c_str(), kernel.second);
+				continue;
+			}
+
+			const auto batched = benchmark::measure(100, [&] { batch.run(kernel.first); });
+			benchmark::printRow(name + kernel.second + " kernel", perPair, batched);
+
+			auto hits       = 0u;
+			auto mismatched = 0u;
+			for (uint32_t i = 0; i < batch.size(); ++i)
+			{
+				hits += batch.getResult(i) <= 1.0f;
+				mismatched += batch.getResult(i) != expected[i];
+			}
+			results += std::string(kernel.second) + " kernel: " + std::to_string(hits) + " hits, " +
+				std::to_string(mismatched) + " results differ from the scalar kernel\n";
+		}
+		std::printf("\nOne pair at a time: %u hits\n%s", perPairHits, results.c_str());
+	}
+
+	using TeamBins = std::array<SpatialIndex, 3>;
+
+	// The team bins BoatSystem builds every update
+	void binTeams(EntityComponentSystem& ecs, TeamBins& teams)
+	{
+		for (auto& team : teams)
+		{
+			team.clear();
+		}
+		ecs.each<const Transform, const Boat>([&](uint32_t i, const Transform& t, const Boat& b)
+		{
+			if (b.team != Boat::BoatTeamEnum::NEUTRAL)
+			{
+				teams[static_cast<size_t>(b.team)].insert(i, t.position, glm::length(t.scale));
+			}
+		});
+		for (auto& team : teams)
+		{
+			team.build();
+		}
+	}
+
+	bool isEnemy(const Boat& boat, const Boat& other)
+	{
+		return other.team != Boat::BoatTeamEnum::NEUTRAL && other.team != boat.team;
+	}
+
+	// What BoatSystem::findTarget used to do for every boat without a target, look at every other boat
+	void findTargetsByScan(EntityComponentSystem& ecs, std::vector<uint32_t>& targets)
+	{
+		ecs.each<const Transform, const Boat>([&](uint32_t i, const Transform& t, const Boat& b)
+		{
+			auto nearest     = SpatialIndex::NONE;
+			auto nearestDist = std::numeric_limits<float>::infinity();
+			ecs.each<const Transform, const Boat>([&](uint32_t j, const Transform& other_t, const Boat& other)
+			{
+				const auto offset = other_t.position - t.position;
+				const auto dist   = glm::dot(offset, offset);
+				if (isEnemy(b, other) && dist < nearestDist)
+				{
+					nearest     = j;
+					nearestDist = dist;
+				}
+			});
+			targets[i] = nearest;
+		});
+	}
+
+	void findTargetsInBins(EntityComponentSystem& ecs, TeamBins& teams, std::vector<uint32_t>& targets)
+	{
+		binTeams(ecs, teams);
+		ecs.each<const Transform, const Boat>([&](uint32_t i, const Transform& t, const Boat& b)
+		{
+			auto nearest     = SpatialIndex::NONE;
+			auto nearestDist = std::numeric_limits<float>::infinity();
+			for (size_t team = 0; team < teams.size(); ++team)
+			{
+				if (team == static_cast<size_t>(b.team))
+				{
+					continue;
+				}
+
+				const auto enemy = teams[team].findNearest(t.position, nearestDist);
+				if (enemy != SpatialIndex::NONE)
+				{
+					nearest     = enemy;
+					nearestDist = glm::distance(t.position, teams[team].getPosition(enemy));
+				}
+			}
+			targets[i] = nearest;
+		});
+	}
+
+	// Every boat's NEAREST_ENEMIES nearest enemies
+	void findNearestByScan(EntityComponentSystem& ecs, std::vector<SpatialIndex::Neighbour>& scratch)
+	{
+		auto sum = 0.0f;
+		ecs.each<const Transform, const Boat>([&](uint32_t, const Transform& t, const Boat& b)
+		{
+			scratch.clear();
+			ecs.each<const Transform, const Boat>([&](uint32_t j, const Transform& other_t, const Boat& other)
+			{
+				const auto offset = other_t.position - t.position;
+				if (isEnemy(b, other))
+				{
+					scratch.push_back({glm::dot(offset, offset), j});
+				}
+			});
+
+			const auto k = std::min<size_t>(NEAREST_ENEMIES, scratch.size());
+			std::partial_sort(scratch.begin(), scratch.begin() + k, scratch.end(),
+			                  [](const SpatialIndex::Neighbour& lhs, const SpatialIndex::Neighbour& rhs)
+			                  {
+				                  return lhs.distanceSquared < rhs.distanceSquared;
+			                  });
+			sum += k > 0 ? scratch[k - 1].distanceSquared : 0.0f;
+		});
+		benchmark::sink = sum;
+	}
+
+	void findNearestInBins(EntityComponentSystem& ecs, TeamBins& teams, std::vector<SpatialIndex::Neighbour>& scratch)
+	{
+		binTeams(ecs, teams);
+		auto sum = 0.0f;
+		ecs.each<const Transform, const Boat>([&](uint32_t, const Transform& t, const Boat& b)
+		{
+			// Boats of the populated scene are red or green, so there's a single enemy team
+			const auto enemies = b.team == Boat::BoatTeamEnum::RED ? Boat::BoatTeamEnum::GREEN : Boat::BoatTeamEnum::RED;
+			teams[static_cast<size_t>(enemies)].findKNearest(t.position, NEAREST_ENEMIES,
+			                                                 std::numeric_limits<float>::infinity(), scratch);
+			sum += scratch.empty() ? 0.0f : scratch.back().distanceSquared;
+		});
+		benchmark::sink = sum;
+	}
+
+	void runTargetingBenchmarks()
+	{
+		EntityComponentSystem ecs;
+		registerComponents(ecs);
+		auto boats = populate(ecs);
+
+		TeamBins teams;
+		std::vector<uint32_t> bruteTargets(ecs.getNumEntities());
+		std::vector<uint32_t> binnedTargets(ecs.getNumEntities());
+		std::vector<SpatialIndex::Neighbour> scratch;
+
+		// Boats sit on a lattice so there are ties, a match is a target at the same distance
+		const auto countMatches = [&]
+		{
+			const auto distance = [&](Entity boat, uint32_t target)
+			{
+				return target == SpatialIndex::NONE
+					       ? -1.0f
+					       : glm::distance(boat.getComponent<const Transform>()->position,
+					                       ecs.getEntityByIdx(target).getComponent<const Transform>()->position);
+			};
+
+			auto matches = 0;
+			for (const auto& boat : boats)
+			{
+				matches += boat.isValid() &&
+					distance(boat, bruteTargets[boat.getIdx()]) == distance(boat, binnedTargets[boat.getIdx()]);
+			}
+			return matches;
+		};
+
+		const auto bruteAll   = benchmark::measure(3, [&] { findTargetsByScan(ecs, bruteTargets); });
+		const auto binnedAll  = benchmark::measure(3, [&] { findTargetsInBins(ecs, teams, binnedTargets); });
+		const auto allMatches = countMatches();
+		const auto bruteK     = benchmark::measure(3, [&] { findNearestByScan(ecs, scratch); });
+		const auto binnedK    = benchmark::measure(3, [&] { findNearestInBins(ecs, teams, scratch); });
+
+		// Worst case, the green team was just wiped out and every red boat looks for a new target
+		for (auto& boat : boats)
+		{
+			if (boat.getComponent<const Boat>()->team == Boat::BoatTeamEnum::GREEN)
+			{
+				boat.destroy();
+			}
+		}
+		const auto bruteWiped   = benchmark::measure(3, [&] { findTargetsByScan(ecs, bruteTargets); });
+		const auto binnedWiped  = benchmark::measure(3, [&] { findTargetsInBins(ecs, teams, binnedTargets); });
+		const auto wipedMatches = countMatches();
+
+		benchmark::printHeader("Boat targeting", "Scan every boat", "Team bins");
+		benchmark::printRow("Nearest enemy of 10k boats", bruteAll, binnedAll);
+		benchmark::printRow("8 nearest enemies of 10k boats", bruteK, binnedK);
+		benchmark::printRow("Nearest enemy of 5k boats after the other team sank", bruteWiped, binnedWiped);
+		std::printf("\nNearest enemy at the same distance for %d of 10000 boats, then %d of 5000\n", allMatches,
+		            wipedMatches);
+	}
+
+	struct Results final
+	{
+		double boats;
+		double sprites;
+		double access;
+		double refAccess;
+		double structural;
+		double churn;
+		double afterBattle;
+	};
+
+	Results runBackend(StorageBackendEnum backend)
+	{
+		EntityComponentSystem ecs(backend);
+		registerComponents(ecs);
+		auto boats = populate(ecs);
+
+		Results results;
+		results.boats      = iterateBoats(ecs);
+		results.sprites    = iterateSprites(ecs);
+		results.access     = handleAccess(boats);
+		results.refAccess  = refAccess(boats);
+		results.structural = structuralChanges(boats);
+		results.churn      = churn(ecs);
+
+		// Most boats sank, their slots stay behind until the ids are reused
+		for (size_t i = 0; i < boats.size(); ++i)
+		{
+			if (i % 10 != 0)
+			{
+				boats[i].destroy();
+			}
+		}
+		results.afterBattle = iterateBoats(ecs);
+		return results;
+	}
+}
+
+void benchmark::runEcsBenchmarks()
+{
+	const auto pools      = runBackend(StorageBackendEnum::COMPONENT_POOLS);
+	const auto archetypes = runBackend(StorageBackendEnum::ARCHETYPES);
+
+	printHeader("ECS storage backends", "Component pools", "Archetypes");
+	printRow("Iterate Transform+Boat+BoatAi (10k boats)", pools.boats, archetypes.boats);
+	printRow("Iterate Transform+Sprite", pools.sprites, archetypes.sprites);
+	printRow("getComponent x3 through 10k handles", pools.access, archetypes.access);
+	printRow("ComponentRef x3 through 10k handles", pools.refAccess, archetypes.refAccess);
+	printRow("Add+remove a component on 10k boats", pools.structural, archetypes.structural);
+	printRow("Create+destroy 1k cannonballs", pools.churn, archetypes.churn);
+	printRow("Iterate boats after 9k of 10k sank", pools.afterBattle, archetypes.afterBattle);
+
+	runStaticBenchmarks();
+	runParallelBenchmarks();
+	runGroupBenchmarks();
+	runSpawnBenchmarks();
+	runBroadphaseBenchmarks();
+	runTargetingBenchmarks();
+	runTimestepBenchmarks();
+	runNarrowphaseBenchmarks();
+}
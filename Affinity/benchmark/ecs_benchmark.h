@@ -0,0 +1,9 @@
+#pragma once
+namespace benchmark
+{
+	/**
+	 * \brief Compare the component pool and archetype storage backends, the runtime and compile time component
+	 * lists, and sequential and parallel loops
+	 */
+	void runEcsBenchmarks();
+}
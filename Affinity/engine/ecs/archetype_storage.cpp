@@ -0,0 +1,238 @@
+#include "archetype_storage.h"
+
+ArchetypeStorage::ArchetypeStorage()
+{
+	// Archetype for entities without any components
+	findOrCreateArchetype(0);
+}
+
+void ArchetypeStorage::addEntity(uint32_t idx)
+{
+	if (idx >= m_locations.size())
+	{
+		m_locations.resize(idx + 1, {NO_ARCHETYPE, 0, 0});
+	}
+
+	m_locations[idx] = pushRow(0, idx);
+}
+
+void ArchetypeStorage::removeEntity(uint32_t idx)
+{
+	const auto location = m_locations[idx];
+	if (location.archetype == NO_ARCHETYPE)
+	{
+		return;
+	}
+
+	const auto& archetype = m_archetypes[location.archetype];
+	for (const auto id : archetype.componentIds)
+	{
+		m_componentInfo[id].destroy(
+			archetype.getColumn(location.chunk, id) + location.row * m_componentInfo[id].size);
+	}
+
+	fillHole(location);
+	m_locations[idx].archetype = NO_ARCHETYPE;
+}
+
+void ArchetypeStorage::compact(const EntityRemap& remap)
+{
+	m_locations.assign(remap.getNumEntities(), {NO_ARCHETYPE, 0, 0});
+
+	for (uint32_t a = 0; a < m_archetypes.size(); ++a)
+	{
+		auto& archetype = m_archetypes[a];
+		for (uint32_t chunk = 0; chunk < archetype.getNumChunks(); ++chunk)
+		{
+			const auto entities = archetype.getEntities(chunk);
+			const auto count    = archetype.getChunkSize(chunk);
+			for (uint32_t row = 0; row < count; ++row)
+			{
+				entities[row] = remap.getIdx(entities[row]);
+				m_locations[entities[row]] = {a, chunk, row};
+			}
+
+			for (const auto id : archetype.componentIds)
+			{
+				const auto& info = m_componentInfo[id];
+				if (!info.remapEntities)
+				{
+					continue;
+				}
+				for (uint32_t row = 0; row < count; ++row)
+				{
+					info.remapEntities(archetype.getColumn(chunk, id) + row * info.size, remap);
+				}
+			}
+		}
+
+		archetype.chunks.resize(archetype.getNumChunks());
+		archetype.chunks.shrink_to_fit();
+	}
+}
+
+void ArchetypeStorage::moveEntities(Span<const uint32_t> indices, uint64_t signature)
+{
+	const auto archetype = findOrCreateArchetype(signature);
+	for (const auto idx : indices)
+	{
+		if (m_locations[idx].archetype != archetype)
+		{
+			moveEntity(idx, archetype);
+		}
+	}
+}
+
+uint32_t ArchetypeStorage::findComponentId(uint32_t type_id) const
+{
+	return type_id < m_componentIds.size() ? m_componentIds[type_id] : NO_COMPONENT;
+}
+
+uint32_t ArchetypeStorage::getNumArchetypes() const
+{
+	return static_cast<uint32_t>(m_archetypes.size());
+}
+
+uint32_t ArchetypeStorage::findOrCreateArchetype(uint64_t signature)
+{
+	const auto it = m_archetypeIndices.find(signature);
+	if (it != m_archetypeIndices.end())
+	{
+		return it->second;
+	}
+
+	Archetype archetype;
+	archetype.signature = signature;
+	archetype.columnOffsets.fill(Archetype::NO_COLUMN);
+	archetype.addEdges.fill(NO_ARCHETYPE);
+	archetype.removeEdges.fill(NO_ARCHETYPE);
+
+	auto bytesPerEntity = static_cast<uint32_t>(sizeof(uint32_t));
+	for (uint32_t id = 0; id < m_componentInfo.size(); ++id)
+	{
+		if (signature & 1ull << id)
+		{
+			archetype.componentIds.push_back(id);
+			bytesPerEntity += m_componentInfo[id].size;
+		}
+	}
+
+	// Find the largest capacity where every column still fits in a chunk after alignment
+	archetype.capacity = ArchetypeChunk::SIZE / bytesPerEntity;
+	while (true)
+	{
+		auto offset = archetype.capacity * static_cast<uint32_t>(sizeof(uint32_t));
+		for (const auto id : archetype.componentIds)
+		{
+			const auto alignment = m_componentInfo[id].alignment;
+			offset = (offset + alignment - 1) / alignment * alignment;
+			archetype.columnOffsets[id] = offset;
+			offset += archetype.capacity * m_componentInfo[id].size;
+		}
+
+		if (offset <= ArchetypeChunk::SIZE)
+		{
+			break;
+		}
+		--archetype.capacity;
+	}
+
+	const auto index = static_cast<uint32_t>(m_archetypes.size());
+	m_archetypes.push_back(std::move(archetype));
+	m_archetypeIndices[signature] = index;
+	return index;
+}
+
+uint32_t ArchetypeStorage::getAddEdge(uint32_t archetype, uint32_t component_id)
+{
+	if (m_archetypes[archetype].addEdges[component_id] == NO_ARCHETYPE)
+	{
+		const auto target = findOrCreateArchetype(m_archetypes[archetype].signature | 1ull << component_id);
+		m_archetypes[archetype].addEdges[component_id] = target;
+	}
+	return m_archetypes[archetype].addEdges[component_id];
+}
+
+uint32_t ArchetypeStorage::getRemoveEdge(uint32_t archetype, uint32_t component_id)
+{
+	if (m_archetypes[archetype].removeEdges[component_id] == NO_ARCHETYPE)
+	{
+		const auto target = findOrCreateArchetype(m_archetypes[archetype].signature & ~(1ull << component_id));
+		m_archetypes[archetype].removeEdges[component_id] = target;
+	}
+	return m_archetypes[archetype].removeEdges[component_id];
+}
+
+void ArchetypeStorage::moveEntity(uint32_t idx, uint32_t dst_archetype)
+{
+	const auto src = m_locations[idx];
+	const auto dst = pushRow(dst_archetype, idx);
+
+	const auto& srcArchetype = m_archetypes[src.archetype];
+	const auto& dstArchetype = m_archetypes[dst.archetype];
+	for (const auto id : srcArchetype.componentIds)
+	{
+		const auto& info     = m_componentInfo[id];
+		const auto component = srcArchetype.getColumn(src.chunk, id) + src.row * info.size;
+
+		if (dstArchetype.hasComponent(id))
+		{
+			info.moveConstruct(dstArchetype.getColumn(dst.chunk, id) + dst.row * info.size, component);
+		}
+		info.destroy(component);
+	}
+
+	fillHole(src);
+	m_locations[idx] = dst;
+}
+
+ArchetypeStorage::EntityLocation ArchetypeStorage::pushRow(uint32_t archetype, uint32_t idx)
+{
+	auto& a = m_archetypes[archetype];
+
+	const auto chunk = a.numEntities / a.capacity;
+	const auto row   = a.numEntities % a.capacity;
+	if (chunk == a.chunks.size())
+	{
+		// Chunks aren't value initialized, the columns are constructed as rows are added
+		a.chunks.emplace_back(new ArchetypeChunk);
+	}
+
+	a.getEntities(chunk)[row] = idx;
+	++a.numEntities;
+
+	return {archetype, chunk, row};
+}
+
+void ArchetypeStorage::fillHole(const EntityLocation& hole)
+{
+	auto& archetype = m_archetypes[hole.archetype];
+
+	const auto last      = archetype.numEntities - 1;
+	const auto lastChunk = last / archetype.capacity;
+	const auto lastRow   = last % archetype.capacity;
+
+	if (hole.chunk != lastChunk || hole.row != lastRow)
+	{
+		for (const auto id : archetype.componentIds)
+		{
+			const auto& info = m_componentInfo[id];
+			const auto from  = archetype.getColumn(lastChunk, id) + lastRow * info.size;
+
+			info.moveConstruct(archetype.getColumn(hole.chunk, id) + hole.row * info.size, from);
+			info.destroy(from);
+		}
+
+		const auto moved = archetype.getEntities(lastChunk)[lastRow];
+		archetype.getEntities(hole.chunk)[hole.row] = moved;
+		m_locations[moved] = {hole.archetype, hole.chunk, hole.row};
+	}
+
+	--archetype.numEntities;
+
+	// Keep one empty chunk around so entities moving back and forth don't reallocate every time
+	while (archetype.chunks.size() > archetype.getNumChunks() + 1)
+	{
+		archetype.chunks.pop_back();
+	}
+}
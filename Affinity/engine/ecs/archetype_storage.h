@@ -0,0 +1,449 @@
+#pragma once
+#include "component.h"
+#include "entity_remap.h"
+#include "../util/span.h"
+
+#include <plog/Log.h>
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * \brief Type-erased operations needed to move components between archetypes
+ */
+struct ComponentTypeInfo final
+{
+	uint32_t size;
+	uint32_t alignment;
+	void (*moveConstruct)(void* dst, void* src);
+	void (*destroy)(void* component);
+	void (*remapEntities)(void* component, const EntityRemap& remap); // nullptr if it stores no handles
+};
+
+/**
+ * \brief Fixed-size block of memory holding the columns of an archetype's entities
+ */
+struct alignas(64) ArchetypeChunk final
+{
+	static constexpr uint32_t SIZE = 16 * 1024;
+
+	uint8_t data[SIZE];
+};
+
+/**
+ * \brief All entities that have the exact same set of components. The entities are kept packed
+ * over chunks, each chunk starts with the entity indices followed by one column per component
+ */
+struct Archetype final
+{
+	static constexpr uint32_t MAX_COMPONENTS = 64;
+	static constexpr uint32_t NO_COLUMN      = 0xFFFFFFFF;
+
+	uint32_t getNumChunks() const
+	{
+		return (numEntities + capacity - 1) / capacity;
+	}
+
+	uint32_t getChunkSize(uint32_t chunk) const
+	{
+		return chunk + 1 < getNumChunks() ? capacity : numEntities - chunk * capacity;
+	}
+
+	uint32_t* getEntities(uint32_t chunk) const
+	{
+		return reinterpret_cast<uint32_t*>(chunks[chunk]->data);
+	}
+
+	uint8_t* getColumn(uint32_t chunk, uint32_t component_id) const
+	{
+		return chunks[chunk]->data + columnOffsets[component_id];
+	}
+
+	bool hasComponent(uint32_t component_id) const
+	{
+		return columnOffsets[component_id] != NO_COLUMN;
+	}
+
+	uint64_t signature = 0;
+	std::vector<uint32_t> componentIds;
+
+	// Byte offset of each component's column in a chunk, indexed by component id
+	std::array<uint32_t, MAX_COMPONENTS> columnOffsets;
+
+	// Entities per chunk
+	uint32_t capacity    = 0;
+	uint32_t numEntities = 0;
+	std::vector<std::unique_ptr<ArchetypeChunk>> chunks;
+
+	// Cached archetype transitions, indexed by component id
+	std::array<uint32_t, MAX_COMPONENTS> addEdges;
+	std::array<uint32_t, MAX_COMPONENTS> removeEdges;
+};
+
+/**
+ * \brief Component storage that groups entities by archetype into fixed-size chunks of SoA columns,
+ * so queries only walk chunks that are guaranteed to have every requested component
+ */
+class ArchetypeStorage final
+{
+public:
+	static constexpr uint32_t NO_COMPONENT = 0xFFFFFFFF;
+
+	ArchetypeStorage();
+
+	template <typename T>
+	void registerComponent();
+
+	template <typename T>
+	bool isComponentRegistered() const;
+
+	/**
+	 * \brief Add a new entity without any components
+	 * \param idx Entity index
+	 */
+	void addEntity(uint32_t idx);
+
+	/**
+	 * \brief Remove an entity and all of its components
+	 * \param idx Entity index
+	 */
+	void removeEntity(uint32_t idx);
+
+	/**
+	 * \brief Renumber the entities after compaction, remap the handles stored in components and release
+	 * spare chunks
+	 * \param remap Where every entity was moved
+	 */
+	void compact(const EntityRemap& remap);
+
+	/**
+	 * \brief Get the component of an entity
+	 * \return Pointer to the component, nullptr if the entity doesn't have it or it isn't registered
+	 */
+	template <typename T>
+	T* get(uint32_t idx);
+
+	/**
+	 * \brief Set the component of an entity, moving the entity to another archetype if needed
+	 * \return False if the component isn't registered
+	 */
+	template <typename T>
+	bool set(uint32_t idx, const T& component);
+
+	/**
+	 * \brief Remove the component of an entity, moving the entity to another archetype if needed
+	 * \return False if the component isn't registered
+	 */
+	template <typename T>
+	bool remove(uint32_t idx);
+
+	/**
+	 * \brief Move entities without components to the archetype with a signature in one go, see
+	 * EntityComponentSystem::createEntities. The components are left unconstructed until initComponents
+	 * \param indices Entity indices
+	 * \param signature Components of the archetype
+	 */
+	void moveEntities(Span<const uint32_t> indices, uint64_t signature);
+
+	/**
+	 * \brief Construct a component of entities moved by moveEntities
+	 */
+	template <typename T>
+	void initComponents(Span<const uint32_t> indices, const T& component);
+
+	/**
+	 * \brief Get the bitmask of a set of components
+	 * \return The bitmask, 0 if any of the components aren't registered
+	 */
+	template <typename... Ts>
+	uint64_t getSignature() const;
+
+	/**
+	 * \brief Call a function for every non-empty chunk whose archetype has every component in
+	 * include and none of the components in exclude. Entities must not be added, removed or
+	 * change archetype during the loop
+	 * \param func Function taking the archetype, the chunk index and the amount of entities in the chunk
+	 */
+	template <typename Func>
+	void forEachChunk(uint64_t include, uint64_t exclude, Func&& func) const;
+
+	/**
+	 * \brief Call a function with the columns of every chunk that has all of the components
+	 * \param func Function taking the entity indices, amount of entities and a pointer to each column
+	 */
+	template <typename... Ts, typename Func>
+	void eachChunk(Func&& func);
+
+	/**
+	 * \brief Call a function for every entity that has all of the components
+	 * \param func Function taking the entity index and a reference to each component
+	 */
+	template <typename... Ts, typename Func>
+	void each(Func&& func);
+
+	template <typename T>
+	uint32_t findComponentId() const;
+
+	/**
+	 * \brief Find the archetype component id of a type, see ComponentId
+	 */
+	uint32_t findComponentId(uint32_t type_id) const;
+
+	uint32_t getNumArchetypes() const;
+private:
+	struct EntityLocation final
+	{
+		uint32_t archetype;
+		uint32_t chunk;
+		uint32_t row;
+	};
+
+	static constexpr uint32_t NO_ARCHETYPE = 0xFFFFFFFF;
+
+	uint32_t findOrCreateArchetype(uint64_t signature);
+	uint32_t getAddEdge(uint32_t archetype, uint32_t component_id);
+	uint32_t getRemoveEdge(uint32_t archetype, uint32_t component_id);
+
+	/**
+	 * \brief Move an entity to another archetype. Components that the destination doesn't have are
+	 * destroyed, components that only the destination has are left unconstructed
+	 */
+	void moveEntity(uint32_t idx, uint32_t dst_archetype);
+
+	/**
+	 * \brief Append a row to an archetype
+	 * \return Location of the new row
+	 */
+	EntityLocation pushRow(uint32_t archetype, uint32_t idx);
+
+	/**
+	 * \brief Fill the hole left by a row whose components were destroyed or moved out with the last row
+	 */
+	void fillHole(const EntityLocation& hole);
+
+	template <typename T>
+	T* getComponentAt(const EntityLocation& location, uint32_t component_id) const;
+
+	template <typename T>
+	static auto getRemapEntities(std::true_type) -> void (*)(void*, const EntityRemap&);
+
+	template <typename T>
+	static auto getRemapEntities(std::false_type) -> void (*)(void*, const EntityRemap&);
+
+	template <typename... Ts, typename Func, size_t... Is>
+	void callWithColumns(const Archetype& archetype, uint32_t chunk, uint32_t count,
+	                     const std::array<uint32_t, sizeof...(Ts)>& ids, Func& func,
+	                     std::index_sequence<Is...>);
+
+	std::vector<ComponentTypeInfo> m_componentInfo;
+	// Archetype component id of every ComponentId, archetype ids are limited to MAX_COMPONENTS
+	std::vector<uint32_t> m_componentIds;
+
+	std::vector<Archetype> m_archetypes;
+	std::unordered_map<uint64_t, uint32_t> m_archetypeIndices;
+
+	std::vector<EntityLocation> m_locations;
+};
+
+template <typename T>
+void ArchetypeStorage::registerComponent()
+{
+	if (isComponentRegistered<T>())
+	{
+		return;
+	}
+
+	if (m_componentInfo.size() >= Archetype::MAX_COMPONENTS)
+	{
+		LOG_FATAL << "Archetype storage supports at most " << Archetype::MAX_COMPONENTS << " components";
+		return;
+	}
+
+	const auto typeId = ComponentId::get<T>();
+	if (typeId >= m_componentIds.size())
+	{
+		m_componentIds.resize(typeId + 1, NO_COMPONENT);
+	}
+	m_componentIds[typeId] = static_cast<uint32_t>(m_componentInfo.size());
+	m_componentInfo.push_back({
+		static_cast<uint32_t>(sizeof(T)),
+		static_cast<uint32_t>(alignof(T)),
+		[](void* dst, void* src) { new(dst) T(std::move(*static_cast<T*>(src))); },
+		[](void* component) { static_cast<T*>(component)->~T(); },
+		getRemapEntities<T>(HasEntityHandles<T>())
+	});
+}
+
+template <typename T>
+bool ArchetypeStorage::isComponentRegistered() const
+{
+	return findComponentId<T>() != NO_COMPONENT;
+}
+
+template <typename T>
+T* ArchetypeStorage::get(uint32_t idx)
+{
+	const auto id = findComponentId<T>();
+	if (id == NO_COMPONENT || idx >= m_locations.size())
+	{
+		return nullptr;
+	}
+
+	const auto& location = m_locations[idx];
+	if (location.archetype == NO_ARCHETYPE || !m_archetypes[location.archetype].hasComponent(id))
+	{
+		return nullptr;
+	}
+
+	return getComponentAt<T>(location, id);
+}
+
+template <typename T>
+bool ArchetypeStorage::set(uint32_t idx, const T& component)
+{
+	const auto id = findComponentId<T>();
+	if (id == NO_COMPONENT)
+	{
+		return false;
+	}
+
+	const auto archetype = m_locations[idx].archetype;
+	if (m_archetypes[archetype].hasComponent(id))
+	{
+		*getComponentAt<T>(m_locations[idx], id) = component;
+		return true;
+	}
+
+	moveEntity(idx, getAddEdge(archetype, id));
+	new(getComponentAt<T>(m_locations[idx], id)) T(component);
+	return true;
+}
+
+template <typename T>
+bool ArchetypeStorage::remove(uint32_t idx)
+{
+	const auto id = findComponentId<T>();
+	if (id == NO_COMPONENT)
+	{
+		return false;
+	}
+
+	const auto archetype = m_locations[idx].archetype;
+	if (m_archetypes[archetype].hasComponent(id))
+	{
+		moveEntity(idx, getRemoveEdge(archetype, id));
+	}
+	return true;
+}
+
+template <typename T>
+void ArchetypeStorage::initComponents(Span<const uint32_t> indices, const T& component)
+{
+	const auto id = findComponentId<T>();
+	for (const auto idx : indices)
+	{
+		new(getComponentAt<T>(m_locations[idx], id)) T(component);
+	}
+}
+
+template <typename... Ts>
+uint64_t ArchetypeStorage::getSignature() const
+{
+	const std::array<uint32_t, sizeof...(Ts)> ids = {findComponentId<Ts>()...};
+
+	uint64_t signature = 0;
+	for (const auto id : ids)
+	{
+		if (id == NO_COMPONENT)
+		{
+			return 0;
+		}
+		signature |= 1ull << id;
+	}
+	return signature;
+}
+
+template <typename Func>
+void ArchetypeStorage::forEachChunk(uint64_t include, uint64_t exclude, Func&& func) const
+{
+	for (const auto& archetype : m_archetypes)
+	{
+		if ((archetype.signature & include) != include || (archetype.signature & exclude) != 0)
+		{
+			continue;
+		}
+
+		const auto numChunks = archetype.getNumChunks();
+		for (uint32_t chunk = 0; chunk < numChunks; ++chunk)
+		{
+			func(archetype, chunk, archetype.getChunkSize(chunk));
+		}
+	}
+}
+
+template <typename... Ts, typename Func>
+void ArchetypeStorage::eachChunk(Func&& func)
+{
+	const std::array<uint32_t, sizeof...(Ts)> ids = {findComponentId<Ts>()...};
+	const auto signature = getSignature<Ts...>();
+	if (signature == 0 && sizeof...(Ts) > 0)
+	{
+		return;
+	}
+
+	forEachChunk(signature, 0, [&](const Archetype& archetype, uint32_t chunk, uint32_t count)
+	{
+		callWithColumns<Ts...>(archetype, chunk, count, ids, func, std::index_sequence_for<Ts...>());
+	});
+}
+
+template <typename... Ts, typename Func>
+void ArchetypeStorage::each(Func&& func)
+{
+	eachChunk<Ts...>([&](const uint32_t* entities, uint32_t count, Ts*... columns)
+	{
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			func(entities[i], columns[i]...);
+		}
+	});
+}
+
+template <typename T>
+uint32_t ArchetypeStorage::findComponentId() const
+{
+	return findComponentId(ComponentId::get<T>());
+}
+
+template <typename T>
+T* ArchetypeStorage::getComponentAt(const EntityLocation& location, uint32_t component_id) const
+{
+	const auto& archetype = m_archetypes[location.archetype];
+	return reinterpret_cast<T*>(archetype.getColumn(location.chunk, component_id)) + location.row;
+}
+
+template <typename T>
+auto ArchetypeStorage::getRemapEntities(std::true_type) -> void (*)(void*, const EntityRemap&)
+{
+	return [](void* component, const EntityRemap& remap) { static_cast<T*>(component)->remapEntities(remap); };
+}
+
+template <typename T>
+auto ArchetypeStorage::getRemapEntities(std::false_type) -> void (*)(void*, const EntityRemap&)
+{
+	return nullptr;
+}
+
+template <typename... Ts, typename Func, size_t... Is>
+void ArchetypeStorage::callWithColumns(const Archetype& archetype, uint32_t chunk, uint32_t count,
+                                       const std::array<uint32_t, sizeof...(Ts)>& ids, Func& func,
+                                       std::index_sequence<Is...>)
+{
+	func(static_cast<const uint32_t*>(archetype.getEntities(chunk)), count,
+	     reinterpret_cast<Ts*>(archetype.getColumn(chunk, ids[Is]))...);
+}
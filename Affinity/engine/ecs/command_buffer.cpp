@@ -0,0 +1,77 @@
+#include "command_buffer.h"
+
+CommandBuffer::CommandBuffer(EntityComponentSystem& ecs)
+	: m_ecs(ecs)
+{
+}
+
+CommandBuffer::~CommandBuffer()
+{
+	clear();
+}
+
+Entity CommandBuffer::createEntity()
+{
+	// Only the id is reserved, the entity is created with every other reserved entity before flushing
+	return m_ecs.reserveEntity();
+}
+
+void CommandBuffer::destroyEntity(Entity entity)
+{
+	m_commands.push_back({
+		[](Entity& e, void*) { e.destroy(); },
+		nullptr,
+		entity,
+		nullptr
+	});
+}
+
+void CommandBuffer::flush()
+{
+	for (auto& command : m_commands)
+	{
+		command.apply(command.entity, command.payload);
+	}
+	clear();
+}
+
+bool CommandBuffer::isEmpty() const
+{
+	return m_commands.empty();
+}
+
+void* CommandBuffer::allocate(size_t size, size_t alignment)
+{
+	m_offset = (m_offset + alignment - 1) / alignment * alignment;
+	if (m_blocks.empty() || m_offset + size > BLOCK_SIZE)
+	{
+		if (!m_blocks.empty())
+		{
+			++m_block;
+		}
+		if (m_block == m_blocks.size())
+		{
+			m_blocks.emplace_back(new uint8_t[BLOCK_SIZE]);
+		}
+		m_offset = 0;
+	}
+
+	const auto memory = m_blocks[m_block].get() + m_offset;
+	m_offset += size;
+	return memory;
+}
+
+void CommandBuffer::clear()
+{
+	for (auto& command : m_commands)
+	{
+		if (command.destroy)
+		{
+			command.destroy(command.payload);
+		}
+	}
+	m_commands.clear();
+
+	m_block  = 0;
+	m_offset = 0;
+}
@@ -0,0 +1,112 @@
+#pragma once
+#include "entity.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+/**
+ * \brief Records structural changes so they can be made from any thread while systems update and applied
+ * in bulk at a sync point. Every thread has its own buffer, see EntityComponentSystem::getCommandBuffer.
+ *
+ * Commands of a buffer are applied in the order they were recorded, buffers are applied in the order their
+ * threads first asked for them
+ */
+class CommandBuffer final
+{
+public:
+	explicit CommandBuffer(EntityComponentSystem& ecs);
+	~CommandBuffer();
+	CommandBuffer(const CommandBuffer& other) = delete;
+	CommandBuffer(CommandBuffer&& other) noexcept = delete;
+	CommandBuffer& operator=(const CommandBuffer& other) = delete;
+	CommandBuffer& operator=(CommandBuffer&& other) noexcept = delete;
+
+	/**
+	 * \brief Reserve a new entity, the handle can be stored and used in other commands right away
+	 * \return The entity, it becomes valid when the buffer is flushed
+	 */
+	Entity createEntity();
+
+	void destroyEntity(Entity entity);
+
+	/**
+	 * \brief Set the entity's component when the buffer is flushed
+	 * \tparam T Component type
+	 * \param entity Entity, may be a reserved entity
+	 * \param component Value to set component to
+	 */
+	template <typename T>
+	void setComponent(Entity entity, T component = T());
+
+	/**
+	 * \brief Remove the entity's component when the buffer is flushed
+	 * \tparam T Component type
+	 */
+	template <typename T>
+	void removeComponent(Entity entity);
+
+	/**
+	 * \brief Apply every recorded command and clear the buffer, reserved entities must have been created first
+	 */
+	void flush();
+
+	bool isEmpty() const;
+private:
+	static constexpr uint32_t BLOCK_SIZE = 16 * 1024;
+
+	struct Command final
+	{
+		void (*apply)(Entity& entity, void* payload);
+		void (*destroy)(void* payload);
+		Entity entity;
+		void* payload;
+	};
+
+	/**
+	 * \brief Allocate memory for a command's payload, payloads never move until the buffer is cleared
+	 */
+	void* allocate(size_t size, size_t alignment);
+
+	void clear();
+
+	EntityComponentSystem& m_ecs;
+	std::vector<Command> m_commands;
+
+	// Payloads, blocks are kept when the buffer is cleared
+	std::vector<std::unique_ptr<uint8_t[]>> m_blocks;
+	size_t m_block  = 0;
+	size_t m_offset = 0;
+};
+
+template <typename T>
+void CommandBuffer::setComponent(Entity entity, T component)
+{
+	static_assert(std::is_base_of<Component, T>::value, "T must have base class of type Component");
+	static_assert(sizeof(T) <= BLOCK_SIZE && alignof(T) <= alignof(std::max_align_t),
+		"T doesn't fit in a command buffer block");
+
+	const auto payload = new(allocate(sizeof(T), alignof(T))) T(std::move(component));
+	m_commands.push_back({
+		[](Entity& e, void* p) { e.setComponent<T>(std::move(*static_cast<T*>(p))); },
+		[](void* p) { static_cast<T*>(p)->~T(); },
+		entity,
+		payload
+	});
+}
+
+template <typename T>
+void CommandBuffer::removeComponent(Entity entity)
+{
+	static_assert(std::is_base_of<Component, T>::value, "T must have base class of type Component");
+
+	m_commands.push_back({
+		[](Entity& e, void*) { e.removeComponent<T>(); },
+		nullptr,
+		entity,
+		nullptr
+	});
+}
@@ -0,0 +1,17 @@
+#include "component.h"
+
+namespace
+{
+	// Constant initialized, so it's zero before any id is handed out
+	uint32_t numIds = 0;
+}
+
+uint32_t ComponentId::getCount()
+{
+	return numIds;
+}
+
+uint32_t ComponentId::next()
+{
+	return numIds++;
+}
@@ -1,10 +1,35 @@
 #pragma once
+#include <cstdint>
+#include <type_traits>
+
+/**
+ * \brief Base type for components. Components are plain data without virtual functions
+ * so that they can be stored contiguously in their component pool
+ */
 struct Component
 {
-	Component() = default;
-	virtual ~Component() = default;
-	Component(const Component& other) = default;
-	Component(Component&& other) noexcept = default;
-	Component& operator=(const Component& other) = default;
-	Component& operator=(Component&& other) noexcept = default;
+};
+
+/**
+ * \brief Dense ids of component types. Every type gets the next id when the program starts, the ECS
+ * indexes its flat component arrays with them so finding a component's storage is a single load
+ */
+class ComponentId final
+{
+public:
+	template <typename T>
+	static uint32_t get()
+	{
+		return s_id<std::remove_cv_t<T>>;
+	}
+
+	/**
+	 * \brief Get the amount of ids handed out so far
+	 */
+	static uint32_t getCount();
+private:
+	static uint32_t next();
+
+	template <typename T>
+	static inline const uint32_t s_id = next();
 };
@@ -0,0 +1,582 @@
+#pragma once
+#include "entity_remap.h"
+#include "../util/span.h"
+
+#include <cstdint>
+#include <algorithm>
+#include <vector>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+/**
+ * \brief How a component pool lays out its components
+ */
+enum class ComponentStorageEnum
+{
+	DENSE,     // One slot per entity indexed by entity, best for components most entities have
+	SPARSE_SET // Packed array plus a sparse index, best for components few entities have
+};
+
+template <typename T>
+class ComponentView;
+
+/**
+ * \brief Check if a change tick comes after another one. Ticks wrap around, so they're compared by distance
+ */
+inline bool isTickAfter(uint32_t tick, uint32_t since)
+{
+	return static_cast<int32_t>(tick - since) > 0;
+}
+
+/**
+ * \brief Type-erased interface of a component pool, only used for structural changes
+ */
+class ComponentPoolBase
+{
+public:
+	ComponentPoolBase() = default;
+	virtual ~ComponentPoolBase() = default;
+	ComponentPoolBase(const ComponentPoolBase& other) = default;
+	ComponentPoolBase(ComponentPoolBase&& other) noexcept = default;
+	ComponentPoolBase& operator=(const ComponentPoolBase& other) = default;
+	ComponentPoolBase& operator=(ComponentPoolBase&& other) noexcept = default;
+
+	/**
+	 * \brief Resize the pool to hold a certain amount of entities
+	 * \param num_entities Amount of entities
+	 */
+	virtual void resize(uint32_t num_entities) = 0;
+
+	/**
+	 * \brief Remove the component of the entity at an index if it has one
+	 * \param idx Entity index
+	 */
+	virtual void remove(uint32_t idx) = 0;
+
+	/**
+	 * \brief Move the components to the entities' new indices, remap the handles they store and release
+	 * the memory of the removed indices
+	 * \param remap Where every entity was moved
+	 */
+	virtual void compact(const EntityRemap& remap) = 0;
+
+	/**
+	 * \brief Mark the component of the entity at an index as changed if it has one
+	 * \param idx Entity index
+	 * \param tick Current change tick
+	 */
+	virtual void markChanged(uint32_t idx, uint32_t tick) = 0;
+
+	/**
+	 * \brief Find where an entity's component is stored in a sparse set pool
+	 * \param idx Entity index
+	 * \return Slot of the component, INVALID_SLOT if the entity doesn't have it
+	 */
+	virtual uint32_t findSlot(uint32_t idx) const = 0;
+
+	/**
+	 * \brief Swap two components of a sparse set pool along with the entities they belong to
+	 * \param a Slot of the first component
+	 * \param b Slot of the second component
+	 */
+	virtual void swapSlots(uint32_t a, uint32_t b) = 0;
+
+	/**
+	 * \brief Get a counter that changes whenever a component is added or removed or components move,
+	 * see ComponentRef
+	 */
+	const uint32_t& getLayoutVersion() const
+	{
+		return m_layoutVersion;
+	}
+
+	static constexpr uint32_t INVALID_SLOT = 0xFFFFFFFF;
+protected:
+	uint32_t m_layoutVersion = 1;
+};
+
+/**
+ * \brief Stores every component of a type contiguously. Dense pools are indexed by entity
+ * and have a separate presence mask, sparse set pools keep the components packed together
+ * with a paged sparse index so memory scales with the amount of components. Every component has the
+ * ticks it was added and last changed at, laid out like the components
+ * \tparam T Component type
+ */
+template <typename T>
+class ComponentPool final : public ComponentPoolBase
+{
+public:
+	ComponentPool(uint32_t num_entities, ComponentStorageEnum storage)
+		: m_storage(storage)
+	{
+		ComponentPool::resize(num_entities);
+	}
+
+	void resize(uint32_t num_entities) override
+	{
+		// Sparse set pages are allocated when they're first used
+		if (m_storage == ComponentStorageEnum::DENSE)
+		{
+			++m_layoutVersion;
+			m_data.resize(num_entities);
+			m_present.resize(num_entities, 0);
+			m_addedTicks.resize(num_entities);
+			m_changedTicks.resize(num_entities);
+		}
+	}
+
+	void remove(uint32_t idx) override
+	{
+		if (m_storage == ComponentStorageEnum::DENSE)
+		{
+			if (!m_present[idx])
+			{
+				return;
+			}
+			++m_layoutVersion;
+			m_present[idx] = 0;
+
+			// Release resources held by non-trivial components (i.e. Script) right away
+			if (!std::is_trivially_destructible<T>::value)
+			{
+				m_data[idx] = T();
+			}
+			return;
+		}
+
+		const auto slot = findSlot(idx);
+		if (slot == INVALID_SLOT)
+		{
+			return;
+		}
+		++m_layoutVersion;
+
+		// Swap with the last component to keep the components packed
+		const auto last = static_cast<uint32_t>(m_data.size()) - 1;
+		if (slot != last)
+		{
+			m_data[slot]         = std::move(m_data[last]);
+			m_entities[slot]     = m_entities[last];
+			m_addedTicks[slot]   = m_addedTicks[last];
+			m_changedTicks[slot] = m_changedTicks[last];
+			sparseSlot(m_entities[slot]) = slot;
+		}
+
+		m_data.pop_back();
+		m_entities.pop_back();
+		m_addedTicks.pop_back();
+		m_changedTicks.pop_back();
+		sparseSlot(idx) = INVALID_SLOT;
+	}
+
+	void compact(const EntityRemap& remap) override
+	{
+		++m_layoutVersion;
+		if (m_storage == ComponentStorageEnum::DENSE)
+		{
+			// Entities only move down, so moving front to back never overwrites a component that still has to move
+			for (uint32_t idx = 0; idx < m_data.size(); ++idx)
+			{
+				const auto newIdx = remap.getIdx(idx);
+				if (m_present[idx] && newIdx != idx)
+				{
+					m_data[newIdx]         = std::move(m_data[idx]);
+					m_present[newIdx]      = 1;
+					m_present[idx]         = 0;
+					m_addedTicks[newIdx]   = m_addedTicks[idx];
+					m_changedTicks[newIdx] = m_changedTicks[idx];
+				}
+			}
+
+			m_data.resize(remap.getNumEntities());
+			m_present.resize(remap.getNumEntities());
+			m_addedTicks.resize(remap.getNumEntities());
+			m_changedTicks.resize(remap.getNumEntities());
+			m_data.shrink_to_fit();
+			m_present.shrink_to_fit();
+			m_addedTicks.shrink_to_fit();
+			m_changedTicks.shrink_to_fit();
+		}
+		else
+		{
+			m_sparse.clear();
+			for (uint32_t slot = 0; slot < m_entities.size(); ++slot)
+			{
+				m_entities[slot] = remap.getIdx(m_entities[slot]);
+				sparseSlot(m_entities[slot]) = slot;
+			}
+
+			m_data.shrink_to_fit();
+			m_entities.shrink_to_fit();
+			m_sparse.shrink_to_fit();
+			m_addedTicks.shrink_to_fit();
+			m_changedTicks.shrink_to_fit();
+		}
+
+		remapEntities(remap, HasEntityHandles<T>());
+	}
+
+	void markChanged(uint32_t idx, uint32_t tick) override
+	{
+		if (m_storage == ComponentStorageEnum::DENSE)
+		{
+			if (m_present[idx])
+			{
+				m_changedTicks[idx] = tick;
+			}
+			return;
+		}
+
+		const auto slot = findSlot(idx);
+		if (slot != INVALID_SLOT)
+		{
+			m_changedTicks[slot] = tick;
+		}
+	}
+
+	bool has(uint32_t idx) const
+	{
+		if (m_storage == ComponentStorageEnum::DENSE)
+		{
+			return m_present[idx] != 0;
+		}
+		return findSlot(idx) != INVALID_SLOT;
+	}
+
+	T* get(uint32_t idx)
+	{
+		if (m_storage == ComponentStorageEnum::DENSE)
+		{
+			return m_present[idx] ? &m_data[idx] : nullptr;
+		}
+
+		const auto slot = findSlot(idx);
+		return slot != INVALID_SLOT ? &m_data[slot] : nullptr;
+	}
+
+	/**
+	 * \brief Get the tick the component of the entity at an index was last changed at
+	 * \return Pointer to the tick, nullptr if the entity doesn't have the component
+	 */
+	uint32_t* findChangedTick(uint32_t idx)
+	{
+		if (m_storage == ComponentStorageEnum::DENSE)
+		{
+			return m_present[idx] ? &m_changedTicks[idx] : nullptr;
+		}
+
+		const auto slot = findSlot(idx);
+		return slot != INVALID_SLOT ? &m_changedTicks[slot] : nullptr;
+	}
+
+	/**
+	 * \brief Set the component of the entity at an index, adding it if the entity doesn't have it yet
+	 * \param tick Current change tick
+	 */
+	void set(uint32_t idx, const T& component, uint32_t tick)
+	{
+		if (m_storage == ComponentStorageEnum::DENSE)
+		{
+			if (!m_present[idx])
+			{
+				m_addedTicks[idx] = tick;
+				++m_layoutVersion;
+			}
+			m_data[idx]         = component;
+			m_present[idx]      = 1;
+			m_changedTicks[idx] = tick;
+			return;
+		}
+
+		const auto slot = findSlot(idx);
+		if (slot != INVALID_SLOT)
+		{
+			m_data[slot]         = component;
+			m_changedTicks[slot] = tick;
+			return;
+		}
+
+		++m_layoutVersion;
+		sparseSlot(idx) = static_cast<uint32_t>(m_data.size());
+		m_data.push_back(component);
+		m_entities.push_back(idx);
+		m_addedTicks.push_back(tick);
+		m_changedTicks.push_back(tick);
+	}
+
+	/**
+	 * \brief Add the same component to entities that don't have it yet, see EntityComponentSystem::createEntities.
+	 * Dense pools fill runs of consecutive indices at once, sparse set pools append every component at once
+	 * \param tick Current change tick
+	 */
+	void addMany(Span<const uint32_t> indices, const T& component, uint32_t tick)
+	{
+		++m_layoutVersion;
+		if (m_storage == ComponentStorageEnum::DENSE)
+		{
+			for (uint32_t begin = 0; begin < indices.size();)
+			{
+				auto end = begin + 1;
+				while (end < indices.size() && indices[end] == indices[end - 1] + 1)
+				{
+					++end;
+				}
+
+				const auto first = indices[begin];
+				const auto count = end - begin;
+				std::fill_n(m_data.begin() + first, count, component);
+				std::fill_n(m_present.begin() + first, count, uint8_t(1));
+				std::fill_n(m_addedTicks.begin() + first, count, tick);
+				std::fill_n(m_changedTicks.begin() + first, count, tick);
+				begin = end;
+			}
+			return;
+		}
+
+		const auto first = static_cast<uint32_t>(m_data.size());
+		for (uint32_t i = 0; i < indices.size(); ++i)
+		{
+			sparseSlot(indices[i]) = first + i;
+		}
+		m_data.insert(m_data.end(), indices.size(), component);
+		m_entities.insert(m_entities.end(), indices.begin(), indices.end());
+		m_addedTicks.insert(m_addedTicks.end(), indices.size(), tick);
+		m_changedTicks.insert(m_changedTicks.end(), indices.size(), tick);
+	}
+
+	uint32_t findSlot(uint32_t idx) const override
+	{
+		const auto page = idx / PAGE_SIZE;
+		if (page >= m_sparse.size() || !m_sparse[page])
+		{
+			return INVALID_SLOT;
+		}
+		return m_sparse[page][idx % PAGE_SIZE];
+	}
+
+	void swapSlots(uint32_t a, uint32_t b) override
+	{
+		if (a == b)
+		{
+			return;
+		}
+
+		++m_layoutVersion;
+		std::swap(m_data[a], m_data[b]);
+		std::swap(m_entities[a], m_entities[b]);
+		std::swap(m_addedTicks[a], m_addedTicks[b]);
+		std::swap(m_changedTicks[a], m_changedTicks[b]);
+		sparseSlot(m_entities[a]) = a;
+		sparseSlot(m_entities[b]) = b;
+	}
+
+	ComponentStorageEnum getStorage() const
+	{
+		return m_storage;
+	}
+
+	ComponentView<T> getView();
+private:
+	static constexpr uint32_t PAGE_SIZE = 1024;
+
+	void remapEntities(const EntityRemap& remap, std::true_type)
+	{
+		for (uint32_t slot = 0; slot < m_data.size(); ++slot)
+		{
+			if (m_storage != ComponentStorageEnum::DENSE || m_present[slot])
+			{
+				m_data[slot].remapEntities(remap);
+			}
+		}
+	}
+
+	void remapEntities(const EntityRemap&, std::false_type)
+	{
+	}
+
+	uint32_t& sparseSlot(uint32_t idx)
+	{
+		const auto page = idx / PAGE_SIZE;
+		if (page >= m_sparse.size())
+		{
+			m_sparse.resize(page + 1);
+		}
+		if (!m_sparse[page])
+		{
+			m_sparse[page] = std::make_unique<uint32_t[]>(PAGE_SIZE);
+			std::fill_n(m_sparse[page].get(), PAGE_SIZE, INVALID_SLOT);
+		}
+		return m_sparse[page][idx % PAGE_SIZE];
+	}
+
+	ComponentStorageEnum m_storage;
+
+	// Dense: indexed by entity. Sparse set: packed
+	std::vector<T> m_data;
+
+	// Dense only
+	std::vector<uint8_t> m_present;
+
+	// Sparse set only, entity of each packed component and the paged entity to slot index
+	std::vector<uint32_t> m_entities;
+	std::vector<std::unique_ptr<uint32_t[]>> m_sparse;
+
+	// Laid out like m_data
+	std::vector<uint32_t> m_addedTicks;
+	std::vector<uint32_t> m_changedTicks;
+};
+
+/**
+ * \brief A non-owning view of a component pool for data oriented access.
+ * Invalidated when components are added or entities are created.
+ *
+ * Components are accessed either by entity index or by slot. In a dense pool
+ * slot n is entity n, in a sparse set pool slots only cover entities that have the component
+ * \tparam T Component type
+ */
+template <typename T>
+class ComponentView final
+{
+public:
+	ComponentView(ComponentPool<T>* pool, T* data, const uint8_t* present, const uint32_t* entities,
+	              const uint32_t* added_ticks, uint32_t* changed_ticks, uint32_t size)
+		: m_pool(pool), m_data(data), m_present(present), m_entities(entities), m_addedTicks(added_ticks),
+		  m_changedTicks(changed_ticks), m_size(size)
+	{
+	}
+
+	/**
+	 * \brief Empty view, no entity has the component
+	 */
+	ComponentView()
+		: ComponentView(nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, 0)
+	{
+	}
+
+	/**
+	 * \brief Check if the entity at an index has the component
+	 * \param idx Entity index
+	 * \return Whether or not the entity has the component
+	 */
+	bool has(uint32_t idx) const
+	{
+		if (m_present)
+		{
+			return m_present[idx] != 0;
+		}
+		return m_pool && m_pool->findSlot(idx) != ComponentPool<T>::INVALID_SLOT;
+	}
+
+	/**
+	 * \brief Get the component of the entity at an index
+	 * \param idx Entity index
+	 * \return Pointer to component if the entity has it, otherwise nullptr
+	 */
+	T* get(uint32_t idx) const
+	{
+		if (m_present)
+		{
+			return m_present[idx] ? m_data + idx : nullptr;
+		}
+		if (!m_pool)
+		{
+			return nullptr;
+		}
+
+		const auto slot = m_pool->findSlot(idx);
+		return slot != ComponentPool<T>::INVALID_SLOT ? m_data + slot : nullptr;
+	}
+
+	/**
+	 * \brief Call a function for every entity that has the component. Sparse set pools are
+	 * visited back to front so the current entity's component can be removed during the loop
+	 * \param func Function taking the entity index and the component
+	 */
+	template <typename Func>
+	void forEach(Func&& func) const
+	{
+		if (m_present)
+		{
+			for (uint32_t i = 0; i < m_size; ++i)
+			{
+				if (m_present[i])
+				{
+					func(i, m_data[i]);
+				}
+			}
+			return;
+		}
+
+		for (auto slot = m_size; slot-- > 0;)
+		{
+			func(m_entities[slot], m_data[slot]);
+		}
+	}
+
+	/**
+	 * \brief Check if the component of an entity was added after a change tick, the entity must have it
+	 */
+	bool addedAfter(uint32_t idx, uint32_t tick) const
+	{
+		return isTickAfter(m_addedTicks[m_present ? idx : m_pool->findSlot(idx)], tick);
+	}
+
+	/**
+	 * \brief Check if the component of an entity was changed after a change tick, the entity must have it
+	 */
+	bool changedAfter(uint32_t idx, uint32_t tick) const
+	{
+		return isTickAfter(m_changedTicks[m_present ? idx : m_pool->findSlot(idx)], tick);
+	}
+
+	/**
+	 * \brief Mark the component of an entity as changed, the entity must have it. Writes through the view
+	 * itself aren't tracked
+	 * \param tick Current change tick, see EntityComponentSystem::getChangeTick
+	 */
+	void markChanged(uint32_t idx, uint32_t tick) const
+	{
+		m_changedTicks[m_present ? idx : m_pool->findSlot(idx)] = tick;
+	}
+
+	// Slot access
+	bool hasSlot(uint32_t n) const { return !m_present || m_present[n] != 0; }
+	uint32_t entityAt(uint32_t n) const { return m_present ? n : m_entities[n]; }
+	T& slot(uint32_t n) const { return m_data[n]; }
+	bool slotAddedAfter(uint32_t n, uint32_t tick) const { return isTickAfter(m_addedTicks[n], tick); }
+	bool slotChangedAfter(uint32_t n, uint32_t tick) const { return isTickAfter(m_changedTicks[n], tick); }
+	void markSlotChanged(uint32_t n, uint32_t tick) const { m_changedTicks[n] = tick; }
+
+	bool isPacked() const { return m_present == nullptr; }
+
+	// Entity of each slot of a sparse set pool, nullptr for dense pools
+	const uint32_t* entities() const { return m_entities; }
+
+	T* data() const { return m_data; }
+	uint32_t size() const { return m_size; }
+
+	T* begin() const { return m_data; }
+	T* end() const { return m_data + m_size; }
+private:
+	ComponentPool<T>* m_pool;
+	T* m_data;
+	const uint8_t* m_present;
+	const uint32_t* m_entities;
+	const uint32_t* m_addedTicks;
+	uint32_t* m_changedTicks;
+	uint32_t m_size;
+};
+
+template <typename T>
+ComponentView<T> ComponentPool<T>::getView()
+{
+	if (m_storage == ComponentStorageEnum::DENSE)
+	{
+		return ComponentView<T>(this, m_data.data(), m_present.data(), nullptr, m_addedTicks.data(),
+		                        m_changedTicks.data(), static_cast<uint32_t>(m_data.size()));
+	}
+
+	return ComponentView<T>(this, m_data.data(), nullptr, m_entities.data(), m_addedTicks.data(),
+	                        m_changedTicks.data(), static_cast<uint32_t>(m_data.size()));
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include "entity.h"
+#include "entity_remap.h"
+
+#include <cstdint>
+#include <type_traits>
+
+/**
+ * \brief Handle to a component of an entity for code that accesses the same component again and again,
+ * e.g. the AI following its target. The component is looked up once and the pointer is kept until the
+ * component's pool changes its layout, i.e. a component of the type is added or removed or components move,
+ * after which the next get looks it up again. Like Entity::getComponent, every get with non-const T marks
+ * the component as changed
+ * \tparam T Component type, const T to only read the component
+ * \tparam Checks CheckedAccess or UncheckedAccess
+ */
+template <typename T, typename Checks = DefaultAccessChecks>
+class ComponentRef final
+{
+public:
+	// Default invalid handle
+	ComponentRef() = default;
+
+	explicit ComponentRef(Entity entity)
+		: m_entity(entity)
+	{
+	}
+
+	/**
+	 * \brief Get the component
+	 * \return Pointer to the component if the entity is valid and has it, otherwise nullptr
+	 */
+	T* get();
+
+	Entity getEntity() const
+	{
+		return m_entity;
+	}
+
+	/**
+	 * \brief Follow the entity when the ECS is compacted, for handles stored in components
+	 */
+	void remapEntities(const EntityRemap& remap)
+	{
+		m_entity        = remap.apply(m_entity);
+		m_layoutVersion = 0;
+	}
+private:
+	using Type = std::remove_const_t<T>;
+
+	Entity m_entity;
+	T* m_component            = nullptr;
+	uint32_t* m_changedTick   = nullptr; // Only for non-const T
+	const uint32_t* m_version = nullptr; // Layout version of the pool, see EntityComponentSystem::findLayoutVersion
+	uint32_t m_layoutVersion  = 0;       // Layout version m_component was looked up at, versions start at 1
+};
+
+template <typename T, typename Checks>
+T* ComponentRef<T, Checks>::get()
+{
+	const auto ecs = m_entity.m_ecs;
+	if (!ecs)
+	{
+		return nullptr;
+	}
+
+	ecs->template checkAccess<Type>(!std::is_const<T>::value);
+
+	// Destroying the entity removes its components, which changes the version as well
+	if (!m_version || *m_version != m_layoutVersion)
+	{
+		m_version       = ecs->template findLayoutVersion<Type>();
+		m_layoutVersion = m_version ? *m_version : 0;
+		m_component     = m_entity.getComponent<T, Checks>();
+		m_changedTick   = m_component && !std::is_const<T>::value
+			                  ? ecs->template findChangedTick<Type>(m_entity.m_idx)
+			                  : nullptr;
+		return m_component;
+	}
+
+	if (m_changedTick)
+	{
+		*m_changedTick = ecs->getChangeTick();
+	}
+	return m_component;
+}
@@ -74,7 +74,7 @@ struct Boat final : Component
 
 struct BoatAi final : Component
 {
-	BoatAi(Entity target = Entity())
+	BoatAi(EntityHandle target = EntityHandle())
 		: target(target)
 	{
 	}
@@ -86,19 +86,29 @@ struct BoatAi final : Component
 		ALIGN
 	} behavior = BehaviorEnum::WANDER; // 4 bytes
 
-	Entity target; // 12 bytes
+	EntityHandle target; // 8 bytes
+
+	void remapEntities(const EntityRemap& remap)
+	{
+		target = remap.apply(target);
+	}
 };
 
 struct Cannonball final : Component
 {
-	Cannonball(glm::vec2 direction = glm::vec2(1, 0), glm::float32_t speed = 0.0f, Entity parent_ship = Entity())
+	Cannonball(glm::vec2 direction = glm::vec2(1, 0), glm::float32_t speed = 0.0f, EntityHandle parent_ship = EntityHandle())
 		: direction(direction), speed(speed), parentShip(parent_ship)
 	{
 	}
 
-	glm::vec2 direction;  // 8 bytes
-	glm::float32_t speed; // 4 bytes;
-	Entity parentShip;    // 12 bytes
+	glm::vec2 direction;     // 8 bytes
+	glm::float32_t speed;    // 4 bytes;
+	EntityHandle parentShip; // 8 bytes
+
+	void remapEntities(const EntityRemap& remap)
+	{
+		parentShip = remap.apply(parentShip);
+	}
 };
 
 struct Particle final : Component
@@ -111,3 +121,7 @@ struct Particle final : Component
 	glm::float32_t lifetime; // 4 bytes
 	glm::float32_t fadetime; // 4 bytes
 };
+
+// Components holding entity handles are copied around with their pools, keep them plain data
+static_assert(std::is_trivially_copyable<BoatAi>::value, "BoatAi must be trivially copyable");
+static_assert(std::is_trivially_copyable<Cannonball>::value, "Cannonball must be trivially copyable");
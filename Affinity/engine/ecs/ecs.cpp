@@ -2,62 +2,617 @@
 #include "entity.h"
 #include "components.h"
 #include "system.h"
+#include "command_buffer.h"
+#include "prefab.h"
 
-void EntityComponentSystem::update(Engine& engine)
+namespace
 {
-	for (auto& s : m_systems)
+	std::atomic<uint64_t> nextInstanceId{1};
+}
+
+EntityComponentSystem::EntityComponentSystem(StorageBackendEnum backend)
+	: m_instanceId(nextInstanceId++), m_scheduler(std::make_unique<SystemScheduler>()),
+	  m_threadPool(std::make_unique<ThreadPool>())
+{
+	if (backend == StorageBackendEnum::ARCHETYPES)
 	{
-		s->update(engine, *this);
+		m_archetypes = std::make_unique<ArchetypeStorage>();
 	}
+
+	internTag("entity");
+
+	// An entity that got its Transform back before the observers ran stays in the spatial index
+	onRemove<Transform>([this](Span<Entity> entities)
+	{
+		for (const auto entity : entities)
+		{
+			if (!findComponent<const Transform>(entity.getIdx()))
+			{
+				m_spatialIndex.remove(entity.getIdx());
+			}
+		}
+	});
 }
 
-void EntityComponentSystem::entityLoop(const std::function<void(uint32_t)>& entity_func) const
+EntityComponentSystem::~EntityComponentSystem() = default;
+
+void EntityComponentSystem::update(Engine& engine)
 {
-	for (uint32_t i = 0; i < m_numEntities; ++i)
+	if (m_systemsChanged)
+	{
+		m_scheduler->build(m_systems);
+		m_systemsChanged = false;
+	}
+
+	// Changes made outside of the update, e.g. while loading, are passed on before the systems see them
+	flushObservers();
+
+	m_updateTick = advanceChangeTick();
+	m_scheduler->run(engine, *this);
+
+	// Changes from here until the next update come after every system started, so every system sees them
+	advanceChangeTick();
+
+	// Apply the structural changes recorded during the updates
+	flushCommandBuffers();
+	flushObservers();
+
+	for (auto& s : m_systems)
 	{
-		entity_func(i);
+		s->sync(engine, *this);
 	}
 }
 
 Entity EntityComponentSystem::createEntity()
 {
-	// If can reuse an id
-	if (!m_availableIds.empty())
+	checkStructuralChange();
+
+	const auto entity = reserveEntity();
+	createReservedEntities();
+	return entity;
+}
+
+void EntityComponentSystem::createEntities(uint32_t count, const Prefab& prefab, std::vector<Entity>& entities)
+{
+	checkStructuralChange();
+	entities.clear();
+
+	// Reuse free ids first, then reserve the rest in one go so the pools only grow once
+	createReservedEntities();
+	m_createdIndices.clear();
+	auto id = m_freeHead.load(std::memory_order_relaxed);
+	while (m_createdIndices.size() < count && id != FREE_LIST_END)
+	{
+		m_createdIndices.push_back(id);
+		id = m_slots[id].nextFree;
+	}
+	m_freeHead.store(id, std::memory_order_relaxed);
+
+	const auto numNew = count - static_cast<uint32_t>(m_createdIndices.size());
+	const auto first  = m_numReservedEntities.fetch_add(numNew, std::memory_order_relaxed);
+	for (auto idx = first; idx < first + numNew; ++idx)
 	{
-		const auto id = *m_availableIds.begin();
-		m_availableIds.erase(m_availableIds.begin());
+		m_createdIndices.push_back(idx);
+	}
+	createReservedEntities();
 
-		for (auto& c : m_components)
+	const auto indices = Span<const uint32_t>(m_createdIndices.data(), count);
+	if (m_archetypes)
+	{
+		// Move the entities straight to their final archetype instead of once per component
+		uint64_t signature = 0;
+		for (const auto& c : prefab.m_components)
 		{
-			c.second.at(id) = nullptr;
+			const auto componentId = m_archetypes->findComponentId(c.typeId);
+			if (componentId != ArchetypeStorage::NO_COMPONENT)
+			{
+				signature |= 1ull << componentId;
+			}
 		}
+		m_archetypes->moveEntities(indices, signature);
+		++m_archetypeLayoutVersion;
+	}
 
-		return Entity(this, id, m_versions[id]);
+	for (const auto& c : prefab.m_components)
+	{
+		c.add(*this, indices, c.component.get());
 	}
 
-	// Otherwise, if no ids are available to be reused
-	for (auto& c : m_components)
+	entities.reserve(count);
+	for (const auto idx : indices)
 	{
-		c.second.emplace_back(nullptr);
+		if (prefab.m_tag != DEFAULT_TAG)
+		{
+			setTag(idx, prefab.m_tag);
+		}
+		entities.push_back(Entity(this, idx, m_slots[idx].version));
 	}
-	m_versions.emplace_back(0);
-	m_tags.emplace_back("entity");
+}
 
-	return Entity(this, m_numEntities++, 0u);
+std::vector<Entity> EntityComponentSystem::createEntities(uint32_t count, const Prefab& prefab)
+{
+	std::vector<Entity> entities;
+	createEntities(count, prefab, entities);
+	return entities;
 }
 
 void EntityComponentSystem::destroyEntity(Entity entity)
 {
 	if (!entity.isValid()) return;
+	checkStructuralChange();
 
+	// Reserved ids have to be taken out of the free ids before another one is added
+	createReservedEntities();
+
+	// Observers hear about every observed component the entity loses
+	for (auto& observed : m_observedComponents)
+	{
+		if (observed && observed->hasComponent(*this, entity.getIdx()))
+		{
+			observed->events.push_back({entity.getIdx(), entity.getVersion(), false});
+		}
+	}
+	if (!m_onDestroy.empty())
+	{
+		m_destroyEvents.push_back({entity.getIdx(), entity.getVersion(), false});
+	}
+	for (auto& index : m_referenceIndices)
+	{
+		index->references.remove(entity.getIdx());
+	}
+	// Only entities something still references are looked up when the observers are flushed
+	for (auto& index : m_referenceIndices)
+	{
+		if (index->references.hasReferrers(entity.getIdx()))
+		{
+			m_referencedDestroyEvents.push_back({entity.getIdx(), entity.getVersion(), false});
+			break;
+		}
+	}
+
+	if (m_archetypes)
+	{
+		m_archetypes->removeEntity(entity.getIdx());
+		++m_archetypeLayoutVersion;
+	}
+	for (auto& group : m_groups)
+	{
+		leaveGroup(entity.getIdx(), group);
+	}
 	for (auto& c : m_components)
 	{
-		c.second.at(entity.getIdx()) = nullptr;
+		if (c)
+		{
+			c->remove(entity.getIdx());
+		}
+	}
+	for (auto signature = m_signatures[entity.getIdx()]; signature; signature &= signature - 1)
+	{
+		m_componentEntities[EntityBitset::countTrailingZeros(signature)].reset(entity.getIdx());
 	}
+	m_signatures[entity.getIdx()] = 0;
+	m_alive.reset(entity.getIdx());
 
-	++m_versions[entity.getIdx()];
-	m_availableIds.emplace(entity.getIdx());
-	m_tags[entity.getIdx()] = "entity";
+	// Push the id onto the free list
+	auto& slot = m_slots[entity.getIdx()];
+	++slot.version;
+	slot.nextFree = m_freeHead.load(std::memory_order_relaxed);
+	m_freeHead.store(entity.getIdx(), std::memory_order_relaxed);
+	m_createdFreeHead = entity.getIdx();
+	++m_numFreeIds;
+
+	removeFromTag(entity.getIdx());
+}
+
+Entity EntityComponentSystem::reserveEntity()
+{
+	// If can reuse an id. The version only goes up when the entity is created, so the handle isn't valid until then
+	auto id = m_freeHead.load(std::memory_order_acquire);
+	while (id != FREE_LIST_END)
+	{
+		if (m_freeHead.compare_exchange_weak(id, m_slots[id].nextFree, std::memory_order_acquire))
+		{
+			return Entity(this, id, m_slots[id].version + 1);
+		}
+	}
+
+	// Otherwise, if no ids are available to be reused
+	return Entity(this, m_numReservedEntities.fetch_add(1, std::memory_order_relaxed), 0u);
+}
+
+CommandBuffer& EntityComponentSystem::getCommandBuffer()
+{
+	struct CachedCommandBuffer
+	{
+		uint64_t instanceId;
+		CommandBuffer* buffer;
+	};
+	thread_local CachedCommandBuffer cached = {0, nullptr};
+
+	if (cached.instanceId != m_instanceId)
+	{
+		std::lock_guard<std::mutex> lock(m_commandBuffersMutex);
+
+		auto& buffer = m_threadCommandBuffers[std::this_thread::get_id()];
+		if (!buffer)
+		{
+			m_commandBuffers.emplace_back(std::make_unique<CommandBuffer>(*this));
+			buffer = m_commandBuffers.back().get();
+		}
+		cached = {m_instanceId, buffer};
+	}
+
+	return *cached.buffer;
+}
+
+void EntityComponentSystem::flushCommandBuffers()
+{
+	createReservedEntities();
+
+	for (auto& buffer : m_commandBuffers)
+	{
+		buffer->flush();
+	}
+}
+
+uint32_t EntityComponentSystem::onDestroy(ObserverFunc func)
+{
+	const auto id = m_nextObserverId++;
+	m_onDestroy.push_back({id, std::move(func)});
+	return id;
+}
+
+void EntityComponentSystem::removeObserver(uint32_t observer)
+{
+	const auto remove = [observer](std::vector<Observer>& observers)
+	{
+		observers.erase(std::remove_if(observers.begin(), observers.end(), [observer](const Observer& o)
+		{
+			return o.id == observer;
+		}), observers.end());
+	};
+
+	remove(m_onDestroy);
+	for (auto& index : m_referenceIndices)
+	{
+		remove(index->observers);
+	}
+	for (auto& observed : m_observedComponents)
+	{
+		if (observed)
+		{
+			remove(observed->onAdd);
+			remove(observed->onRemove);
+		}
+	}
+}
+
+void EntityComponentSystem::flushObservers()
+{
+	// Observers may make structural changes of their own, keep going until nothing is left
+	std::vector<ComponentEvent> events;
+	for (auto pending = true; pending;)
+	{
+		pending = false;
+		for (auto& observed : m_observedComponents)
+		{
+			if (!observed || observed->events.empty())
+			{
+				continue;
+			}
+			pending = true;
+
+			// Batches of adds and removes, in the order they happened
+			events.swap(observed->events);
+			for (size_t begin = 0; begin < events.size();)
+			{
+				auto end = begin + 1;
+				while (end < events.size() && events[end].added == events[begin].added)
+				{
+					++end;
+				}
+				notifyObservers(events[begin].added ? observed->onAdd : observed->onRemove, &events[begin], end - begin);
+				begin = end;
+			}
+			events.clear();
+		}
+
+		if (!m_destroyEvents.empty())
+		{
+			pending = true;
+			events.swap(m_destroyEvents);
+			notifyObservers(m_onDestroy, events.data(), events.size());
+			events.clear();
+		}
+
+		if (!m_referencedDestroyEvents.empty())
+		{
+			pending = true;
+			events.swap(m_referencedDestroyEvents);
+			for (auto& index : m_referenceIndices)
+			{
+				notifyReferrers(*index, events);
+			}
+			events.clear();
+		}
+	}
+}
+
+void EntityComponentSystem::notifyObservers(const std::vector<Observer>& observers, const ComponentEvent* events,
+                                            size_t count)
+{
+	if (observers.empty())
+	{
+		return;
+	}
+
+	m_observedEntities.clear();
+	for (size_t i = 0; i < count; ++i)
+	{
+		m_observedEntities.push_back(Entity(this, events[i].idx, events[i].version));
+	}
+	for (const auto& observer : observers)
+	{
+		observer.func(Span<Entity>(m_observedEntities.data(), static_cast<uint32_t>(m_observedEntities.size())));
+	}
+}
+
+void EntityComponentSystem::notifyReferrers(ReferenceIndex& index, const std::vector<ComponentEvent>& destroyed)
+{
+	if (index.observers.empty())
+	{
+		return;
+	}
+
+	// The index may have been reused, only handles to the destroyed entity itself count
+	m_referrerEvents.clear();
+	for (const auto& event : destroyed)
+	{
+		index.references.forEachReferrer(event.idx, [&](uint32_t referrer, EntityHandle target)
+		{
+			if (target.getVersion() == event.version)
+			{
+				m_referrerEvents.push_back({referrer, m_slots[referrer].version, false});
+			}
+		});
+	}
+	notifyObservers(index.observers, m_referrerEvents.data(), m_referrerEvents.size());
+}
+
+void EntityComponentSystem::enterGroup(uint32_t idx, Group& group)
+{
+	if ((m_signatures[idx] & group.owned) != group.owned)
+	{
+		return;
+	}
+
+	for (const auto pool : group.pools)
+	{
+		pool->swapSlots(pool->findSlot(idx), group.size);
+	}
+	++group.size;
+}
+
+void EntityComponentSystem::leaveGroup(uint32_t idx, Group& group)
+{
+	if ((m_signatures[idx] & group.owned) != group.owned)
+	{
+		return;
+	}
+
+	--group.size;
+	for (const auto pool : group.pools)
+	{
+		pool->swapSlots(pool->findSlot(idx), group.size);
+	}
+}
+
+const EntityComponentSystem::Group* EntityComponentSystem::findGroup(uint64_t include) const
+{
+	const Group* found = nullptr;
+	for (const auto& group : m_groups)
+	{
+		if ((group.owned & include) == group.owned && (!found || group.size < found->size))
+		{
+			found = &group;
+		}
+	}
+	return found;
+}
+
+void EntityComponentSystem::createReservedEntities()
+{
+	// Reused ids, their components were already removed when the entity was destroyed
+	const auto freeHead = m_freeHead.load(std::memory_order_relaxed);
+	for (auto id = m_createdFreeHead; id != freeHead;)
+	{
+		auto& slot = m_slots[id];
+		if (m_archetypes)
+		{
+			m_archetypes->addEntity(id);
+		}
+		++slot.version;
+		m_alive.set(id);
+		addToTag(id, DEFAULT_TAG);
+
+		id            = slot.nextFree;
+		slot.nextFree = NOT_FREE;
+		--m_numFreeIds;
+	}
+	m_createdFreeHead = freeHead;
+
+	// New ids
+	const auto numEntities = m_numReservedEntities.load(std::memory_order_relaxed);
+	if (numEntities == m_numEntities)
+	{
+		return;
+	}
+
+	for (auto& c : m_components)
+	{
+		if (c)
+		{
+			c->resize(numEntities);
+		}
+	}
+	for (auto& entities : m_componentEntities)
+	{
+		entities.resize(numEntities);
+	}
+	m_alive.resize(numEntities);
+	for (auto idx = m_numEntities; idx < numEntities; ++idx)
+	{
+		if (m_archetypes)
+		{
+			m_archetypes->addEntity(idx);
+		}
+		m_slots.push_back({0, NOT_FREE});
+		m_entityTags.push_back({NO_TAG, 0});
+		m_signatures.push_back(0);
+		m_alive.set(idx);
+		addToTag(idx, DEFAULT_TAG);
+		m_entityIndices.emplace_back(idx);
+	}
+	m_numEntities = numEntities;
+}
+
+EntityRemap EntityComponentSystem::compact()
+{
+	checkStructuralChange();
+	flushCommandBuffers();
+	flushObservers();
+
+	// Entities keep their order. An entity moving onto an index gets a version above every version
+	// the index had so far, so handles that weren't remapped can't point at it
+	EntityRemap remap;
+	remap.m_moves.resize(m_numEntities, {0, EntityRemap::DESTROYED, 0});
+	for (uint32_t idx = 0; idx < m_numEntities; ++idx)
+	{
+		const auto& slot = m_slots[idx];
+		if (slot.nextFree != NOT_FREE)
+		{
+			continue;
+		}
+
+		const auto newIdx  = remap.m_numEntities++;
+		const auto version = newIdx == idx ? slot.version : std::max(slot.version, m_slots[newIdx].version + 1);
+		remap.m_moves[idx] = {slot.version, newIdx, version};
+
+		m_slots[newIdx]      = {version, NOT_FREE};
+		m_entityTags[newIdx] = m_entityTags[idx];
+		m_signatures[newIdx] = m_signatures[idx];
+	}
+
+	const auto numEntities = remap.m_numEntities;
+	if (m_archetypes)
+	{
+		m_archetypes->compact(remap);
+		++m_archetypeLayoutVersion;
+	}
+	for (auto& c : m_components)
+	{
+		if (c)
+		{
+			c->compact(remap);
+		}
+	}
+
+	// Components that moved count as changed, so anything cached by entity index gets rebuilt
+	const auto tick = getChangeTick();
+	for (uint32_t idx = 0; idx < remap.m_moves.size(); ++idx)
+	{
+		const auto newIdx = remap.m_moves[idx].idx;
+		if (newIdx == EntityRemap::DESTROYED || newIdx == idx)
+		{
+			continue;
+		}
+
+		for (auto& c : m_components)
+		{
+			if (c)
+			{
+				c->markChanged(newIdx, tick);
+			}
+		}
+	}
+	for (auto& entities : m_taggedEntities)
+	{
+		for (auto& idx : entities)
+		{
+			idx = remap.getIdx(idx);
+		}
+	}
+
+	m_slots.resize(numEntities);
+	m_entityTags.resize(numEntities);
+	m_signatures.resize(numEntities);
+	m_entityIndices.resize(numEntities);
+	m_slots.shrink_to_fit();
+	m_entityTags.shrink_to_fit();
+	m_signatures.shrink_to_fit();
+
+	// Every entity is alive after compaction, the component sets are rebuilt from the signatures
+	m_alive.resize(numEntities);
+	m_alive.shrinkToFit();
+	for (auto& entities : m_componentEntities)
+	{
+		entities.resize(numEntities);
+		entities.clear();
+		entities.shrinkToFit();
+	}
+	for (uint32_t idx = 0; idx < numEntities; ++idx)
+	{
+		m_alive.set(idx);
+		for (auto signature = m_signatures[idx]; signature; signature &= signature - 1)
+		{
+			m_componentEntities[EntityBitset::countTrailingZeros(signature)].set(idx);
+		}
+	}
+	m_entityIndices.shrink_to_fit();
+
+	m_freeHead.store(FREE_LIST_END, std::memory_order_relaxed);
+	m_createdFreeHead = FREE_LIST_END;
+	m_numFreeIds      = 0;
+	m_numReservedEntities.store(numEntities, std::memory_order_relaxed);
+	m_numEntities = numEntities;
+
+	// The spatial index is rebuilt from scratch the next time it's used, the reference indices right away
+	m_spatialIndex.clear();
+	m_spatialIndexTick = 0;
+	for (auto& index : m_referenceIndices)
+	{
+		index->references.clear();
+		index->readAll(index->references);
+	}
+
+	return remap;
+}
+
+void EntityComponentSystem::checkStructuralChange() const
+{
+#ifndef NDEBUG
+	const auto system = SystemScheduler::getCurrentSystem();
+	if (system && !system->getAccess().exclusive)
+	{
+		LOG_FATAL << typeid(*system).name()
+			<< " makes a structural change in update, it has to be recorded in a command buffer";
+	}
+#endif
+}
+
+ArchetypeStorage* EntityComponentSystem::getArchetypeStorage() const
+{
+	return m_archetypes.get();
+}
+
+StorageBackendEnum EntityComponentSystem::getStorageBackend() const
+{
+	return m_archetypes ? StorageBackendEnum::ARCHETYPES : StorageBackendEnum::COMPONENT_POOLS;
+}
+
+ThreadPool& EntityComponentSystem::getThreadPool() const
+{
+	return *m_threadPool;
 }
 
 uint32_t EntityComponentSystem::getNumEntities() const
@@ -67,32 +622,189 @@ uint32_t EntityComponentSystem::getNumEntities() const
 
 uint32_t EntityComponentSystem::getNumActiveEntities() const
 {
-	return m_numEntities - static_cast<uint32_t>(m_availableIds.size());
+	return m_numEntities - m_numFreeIds;
+}
+
+uint32_t EntityComponentSystem::getChangeTick() const
+{
+	return m_changeTick.load(std::memory_order_relaxed);
+}
+
+uint32_t EntityComponentSystem::advanceChangeTick()
+{
+	return m_changeTick.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
+const SpatialIndex& EntityComponentSystem::getSpatialIndex()
+{
+	checkAccess<Transform>(false);
+
+	// Systems that read transforms may ask at the same time, nothing writes transforms while they run
+	std::lock_guard<std::mutex> lock(m_spatialIndexMutex);
+	syncSpatialIndex();
+	return m_spatialIndex;
+}
+
+void EntityComponentSystem::syncSpatialIndex()
+{
+	// Transforms changed from here on get a later tick, so the next sync sees them
+	const auto since   = m_spatialIndexTick;
+	m_spatialIndexTick = getChangeTick();
+	advanceChangeTick();
+
+	const auto insert = [this](uint32_t idx, const Transform& t)
+	{
+		m_spatialIndex.insert(idx, t.position, glm::length(t.scale));
+	};
+
+	if (m_archetypes)
+	{
+		m_archetypes->each<Transform>(insert);
+	}
+	else if (findComponentPool<Transform>())
+	{
+		const auto view = findComponentView<Transform>();
+		for (uint32_t n = 0; n < view.size(); ++n)
+		{
+			if (view.hasSlot(n) && (since == 0 || view.slotChangedAfter(n, since)))
+			{
+				insert(view.entityAt(n), view.slot(n));
+			}
+		}
+	}
+
+	// Destroyed entities and removed transforms are taken out of the bins here as well
+	m_spatialIndex.build();
+}
+
+uint32_t EntityComponentSystem::getQueryTick() const
+{
+	const auto system = SystemScheduler::getCurrentSystem();
+	return system ? system->getLastRunTick() : m_updateTick;
 }
 
 Entity EntityComponentSystem::getEntityByIdx(uint32_t idx)
 {
-	if (idx < m_numEntities)
+	if (idx < m_numEntities && m_slots[idx].nextFree == NOT_FREE)
 	{
-		return Entity(this, idx, m_versions[idx]);
+		return Entity(this, idx, m_slots[idx].version);
 	}
 
 	return Entity();
 }
 
-std::vector<Entity> EntityComponentSystem::findEntitiesWithTag(const std::string& tag)
+Entity EntityComponentSystem::getEntity(EntityHandle handle)
 {
-	// todo: replace with faster method, cache in set?
+	if (!isValid(handle))
+	{
+		return Entity();
+	}
 
-	auto vec = std::vector<Entity>();
+	return Entity(this, handle.getIdx(), handle.getVersion());
+}
 
-	for (auto i = 0u; i < m_numEntities; ++i)
+bool EntityComponentSystem::isValid(EntityHandle handle) const
+{
+	const auto idx = handle.getIdx();
+	return idx < m_numEntities && m_slots[idx].nextFree == NOT_FREE && m_slots[idx].version == handle.getVersion();
+}
+
+uint32_t EntityComponentSystem::internTag(const std::string& tag)
+{
+	const auto it = m_tagIds.find(tag);
+	if (it != m_tagIds.end())
 	{
-		if (m_tags[i] == tag)
-		{
-			vec.emplace_back(getEntityByIdx(i));
-		}
+		return it->second;
+	}
+
+	const auto id = static_cast<uint32_t>(m_tagNames.size());
+	m_tagIds.emplace(tag, id);
+	m_tagNames.push_back(tag);
+	m_taggedEntities.emplace_back();
+	return id;
+}
+
+uint32_t EntityComponentSystem::findTag(const std::string& tag) const
+{
+	const auto it = m_tagIds.find(tag);
+	return it != m_tagIds.end() ? it->second : NO_TAG;
+}
+
+const std::string& EntityComponentSystem::getTagName(uint32_t tag) const
+{
+	return m_tagNames.at(tag);
+}
+
+Entity EntityComponentSystem::findEntityWithTag(uint32_t tag)
+{
+	if (tag >= m_taggedEntities.size() || m_taggedEntities[tag].empty())
+	{
+		return Entity();
+	}
+	return getEntityByIdx(m_taggedEntities[tag].front());
+}
+
+Entity EntityComponentSystem::findEntityWithTag(const std::string& tag)
+{
+	return findEntityWithTag(findTag(tag));
+}
+
+Span<const uint32_t> EntityComponentSystem::getEntitiesWithTag(uint32_t tag) const
+{
+	if (tag >= m_taggedEntities.size())
+	{
+		return {};
+	}
+	return Span<const uint32_t>(m_taggedEntities[tag].data(), static_cast<uint32_t>(m_taggedEntities[tag].size()));
+}
+
+void EntityComponentSystem::findEntitiesWithTag(const std::string& tag, std::vector<Entity>& entities)
+{
+	entities.clear();
+	for (const auto idx : getEntitiesWithTag(findTag(tag)))
+	{
+		entities.push_back(getEntityByIdx(idx));
 	}
+}
 
+std::vector<Entity> EntityComponentSystem::findEntitiesWithTag(const std::string& tag)
+{
+	auto vec = std::vector<Entity>();
+	findEntitiesWithTag(tag, vec);
 	return vec;
 }
+
+void EntityComponentSystem::setTag(uint32_t idx, uint32_t tag)
+{
+	checkStructuralChange();
+
+	if (tag >= m_taggedEntities.size())
+	{
+		LOG_WARNING << "Tag " << tag << " has not been interned";
+		return;
+	}
+
+	removeFromTag(idx);
+	addToTag(idx, tag);
+}
+
+void EntityComponentSystem::addToTag(uint32_t idx, uint32_t tag)
+{
+	auto& entities    = m_taggedEntities[tag];
+	m_entityTags[idx] = {tag, static_cast<uint32_t>(entities.size())};
+	entities.push_back(idx);
+}
+
+void EntityComponentSystem::removeFromTag(uint32_t idx)
+{
+	const auto entityTag = m_entityTags[idx];
+	auto& entities       = m_taggedEntities[entityTag.tag];
+
+	// Swap with the last entity of the tag to keep the list packed
+	const auto last = entities.back();
+	entities[entityTag.slot] = last;
+	m_entityTags[last].slot  = entityTag.slot;
+	entities.pop_back();
+
+	m_entityTags[idx] = {NO_TAG, 0};
+}
@@ -1,43 +1,169 @@
 #pragma once
 #include "component.h"
+#include "component_pool.h"
+#include "entity_bitset.h"
+#include "entity_handle.h"
+#include "entity_references.h"
+#include "archetype_storage.h"
+#include "query.h"
+#include "spatial_index.h"
 #include "system.h"
+#include "system_scheduler.h"
+#include "../util/thread_pool.h"
 
 #include <plog/Log.h>
 
+#include <algorithm>
+#include <atomic>
 #include <cstdint>
 #include <vector>
 #include <unordered_map>
-#include <typeindex>
 #include <memory>
 #include <functional>
-#include <unordered_set>
-
-// todo: maybe parallelize?
-// todo: add ability to "compress" if the majority of entities are unused
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <array>
+#include <tuple>
+#include <utility>
 
 class Engine;
 class Entity;
 class System;
+class CommandBuffer;
+class Prefab;
+
+/**
+ * \brief Where the ECS keeps component data
+ */
+enum class StorageBackendEnum
+{
+	COMPONENT_POOLS, // One pool per component type indexed by entity, supports component views
+	ARCHETYPES       // Entities grouped by their set of components into chunks
+};
 
 class EntityComponentSystem final
 {
 public:
-	EntityComponentSystem() = default;
+	// Entities per work item of the parallel loops with component pools, a multiple of 64 so that
+	// items cover whole cache lines of every dense pool
+	static constexpr uint32_t PARALLEL_CHUNK_SIZE = 1024;
 
+	explicit EntityComponentSystem(StorageBackendEnum backend = StorageBackendEnum::COMPONENT_POOLS);
+	~EntityComponentSystem();
+	EntityComponentSystem(const EntityComponentSystem& other) = delete;
+	EntityComponentSystem(EntityComponentSystem&& other) noexcept = delete;
+	EntityComponentSystem& operator=(const EntityComponentSystem& other) = delete;
+	EntityComponentSystem& operator=(EntityComponentSystem&& other) noexcept = delete;
+
+	/**
+	 * \brief Update every system, see SystemScheduler for which systems may run at the same time,
+	 * then sync them in the order they were added
+	 * \param engine Engine
+	 */
 	void update(Engine& engine);
 
+	/**
+	 * \brief Add a system, systems that conflict update in the order they were added
+	 * \tparam T System type
+	 */
 	template <typename T>
 	void addSystem();
 
-	// for later use, possible multithreading
-	void entityLoop(const std::function<void(uint32_t)>& entity_func) const;
+	/**
+	 * \brief Call a function for the index of every entity, destroyed entities are skipped
+	 * \param entity_func Function taking the entity index
+	 */
+	template <typename Func>
+	void entityLoop(Func&& entity_func) const;
+
+	/**
+	 * \brief Call a function for the index of every entity on the thread pool, destroyed entities are skipped
+	 * \param entity_func Function taking the entity index, must be safe to call from several threads at once
+	 */
+	template <typename Func>
+	void parallelEntityLoop(Func&& entity_func);
+
+	/**
+	 * \brief Call a function for every entity matching a query, see query.h for the filters.
+	 * Storage is resolved once and only matching entities are visited. Entities must not be
+	 * created and components must not be added during the loop
+	 * \tparam Qs Components and filters
+	 * \param func Function taking the entity index followed by the requested components
+	 */
+	template <typename... Qs, typename Func>
+	void each(Func&& func);
+
+	/**
+	 * \brief Call a function for every contiguous run of entities matching a query. The components of
+	 * the run are passed as spans indexed like the entity span, so loops over them can auto-vectorize.
+	 * Optional<T> isn't supported
+	 * \tparam Qs Components and filters
+	 * \param func Function taking a Span<const uint32_t> of entity indices followed by a Span per component
+	 */
+	template <typename... Qs, typename Func>
+	void eachSpan(Func&& func);
+
+	/**
+	 * \brief Like each, but the matching entities are split into work items that run on the thread pool.
+	 * Components of other entities must not be written and nothing may be created, destroyed, added or
+	 * removed during the loop
+	 * \tparam Qs Components and filters
+	 * \param func Function taking the entity index followed by the requested components
+	 */
+	template <typename... Qs, typename Func>
+	void parallelEach(Func&& func);
+
+	/**
+	 * \brief Like parallelEach, but also passes the work item of the entity. The items are the same
+	 * for every loop over a query until entities or components change, so results can be written per
+	 * item in one loop and used in the next, e.g. counting then filling
+	 * \tparam Qs Components and filters
+	 * \param func Function taking the work item, the entity index and the requested components
+	 */
+	template <typename... Qs, typename Func>
+	void parallelEachChunk(Func&& func);
+
+	/**
+	 * \brief Get the amount of work items parallelEachChunk splits a query into
+	 * \tparam Qs Components and filters
+	 * \return Amount of work items
+	 */
+	template <typename... Qs>
+	uint32_t getNumParallelChunks();
+
+	/**
+	 * \brief Reduce every entity matching a query to a single value on the thread pool. Every work item
+	 * starts from identity and the items are combined in order, so the result is the same no matter
+	 * how many threads there are or which thread ran which item
+	 * \tparam Qs Components and filters
+	 * \param identity Starting value of every work item
+	 * \param func Function taking the work item's value by reference, the entity index and the components
+	 * \param combine Function combining two values into one
+	 * \return The combined value, identity if nothing matched
+	 */
+	template <typename... Qs, typename T, typename Func, typename Combine>
+	T parallelReduce(T identity, Func&& func, Combine&& combine);
 
 	/**
 	 * \brief Register a component in the ECS
 	 * \tparam T Component type
+	 * \param storage How the component is stored, use SPARSE_SET for components only a few entities have
 	 */
 	template <typename T>
-	void registerComponent();
+	void registerComponent(ComponentStorageEnum storage = ComponentStorageEnum::DENSE);
+
+	/**
+	 * \brief Keep the components of the entities that have every one of Ts at the front of their pools,
+	 * in the same order, so queries requiring all of Ts walk them as parallel arrays. The group owns its
+	 * components, they must be registered as SPARSE_SET and can't be owned by another group. Adding or
+	 * removing an owned component costs a swap in every owned pool. Does nothing with the archetype storage,
+	 * which already keeps the components of entities with the same components together
+	 * \tparam Ts Component types
+	 */
+	template <typename... Ts>
+	void addGroup();
 
 	/**
 	 * \brief Create a new blank entity
@@ -45,9 +171,114 @@ public:
 	 */
 	Entity createEntity();
 
+	/**
+	 * \brief Create entities with the components and tag of a prefab. Ids are reused like createEntity does,
+	 * the pools grow once for the whole batch and every component is copied into runs of entities at once
+	 * \param count Amount of entities
+	 * \param prefab Prefab
+	 * \param entities Cleared, then filled with the created entities
+	 */
+	void createEntities(uint32_t count, const Prefab& prefab, std::vector<Entity>& entities);
+
+	std::vector<Entity> createEntities(uint32_t count, const Prefab& prefab);
+
 	// todo: destroy entity by idx too
 	void destroyEntity(Entity entity);
 
+	/**
+	 * \brief Reserve an entity without creating it, safe to call from any thread while systems update
+	 * \return The entity, it becomes valid once reserved entities are created by flushCommandBuffers
+	 */
+	Entity reserveEntity();
+
+	/**
+	 * \brief Get the command buffer of the calling thread, safe to call from any thread
+	 * \return Command buffer, flushed by flushCommandBuffers
+	 */
+	CommandBuffer& getCommandBuffer();
+
+	/**
+	 * \brief Create the reserved entities and apply every thread's command buffer. Must not be called while
+	 * systems are updating, the ECS calls it after every system has been updated
+	 */
+	void flushCommandBuffers();
+
+	/**
+	 * \brief Function called by an observer with the entities a structural change happened to, in the order
+	 * the changes were made
+	 */
+	using ObserverFunc = std::function<void(Span<Entity> entities)>;
+
+	/**
+	 * \brief Observe entities getting a component. Changes are collected and passed to the observer in batches
+	 * by flushObservers, adds and removes of the same component are passed in the order they happened
+	 * \tparam T Component type
+	 * \param func Function called with the entities that got the component
+	 * \return Observer id for removeObserver
+	 */
+	template <typename T>
+	uint32_t onAdd(ObserverFunc func);
+
+	/**
+	 * \brief Observe entities losing a component, including when they're destroyed, see onAdd.
+	 * Observers are called after the change, so the component is gone unless it was added again since
+	 * \tparam T Component type
+	 * \param func Function called with the entities that lost the component
+	 * \return Observer id for removeObserver
+	 */
+	template <typename T>
+	uint32_t onRemove(ObserverFunc func);
+
+	/**
+	 * \brief Observe entities being destroyed, see onAdd. The handles passed to the observer are already invalid
+	 * \param func Function called with the destroyed entities
+	 * \return Observer id for removeObserver
+	 */
+	uint32_t onDestroy(ObserverFunc func);
+
+	/**
+	 * \brief Observe entities whose component still references an entity through a handle field when that entity
+	 * is destroyed, see onAdd. The ECS keeps an index from every referenced entity to the entities referencing
+	 * it, so a destroy only visits its own referrers. The index is updated when the component is set and by
+	 * setReference, the field must not be written to directly
+	 * \tparam T Component type
+	 * \param field Handle field of the component
+	 * \param func Function called with the entities that referenced a destroyed entity
+	 * \return Observer id for removeObserver
+	 */
+	template <typename T>
+	uint32_t onReferenceDestroyed(EntityHandle T::*field, ObserverFunc func);
+
+	/**
+	 * \brief Set a handle field of an entity's component and update the reference indices of the component,
+	 * see onReferenceDestroyed
+	 * \tparam T Component type
+	 * \param idx Entity index
+	 * \param field Handle field of the component
+	 * \param target Entity to reference
+	 * \return False if the entity doesn't have the component
+	 */
+	template <typename T>
+	bool setReference(uint32_t idx, EntityHandle T::*field, EntityHandle target);
+
+	void removeObserver(uint32_t observer);
+
+	/**
+	 * \brief Pass the structural changes collected since the last flush to the observers. Observers may make
+	 * structural changes, those are passed on before this returns. Observers must not be added or removed
+	 * and must not flush during the flush. The ECS flushes before systems update and after the command buffers are applied
+	 */
+	void flushObservers();
+
+	/**
+	 * \brief Move every entity down to the lowest free index and release the memory of the indices left over,
+	 * for when most entities have been destroyed. Handles stored in components are remapped, see EntityRemap,
+	 * other handles become invalid. Flushes the command buffers and observers first, must not be called while
+	 * systems are updating
+	 * \return Where every entity was moved
+	 */
+	EntityRemap compact();
+
 	/**
 	 * \brief Check if a component has been registered in the ECS
 	 * \tparam T Component type
@@ -57,12 +288,33 @@ public:
 	bool isComponentRegistered();
 
 	/**
-	 * \brief Get a reference to the component vector for data oriented access
+	 * \brief Get a typed view of the component pool for data oriented access. Only available with
+	 * the COMPONENT_POOLS backend
 	 * \tparam T Component type
-	 * \return Reference to vector for component
+	 * \return View of the component pool, invalidated when an entity is created
 	 */
 	template <typename T>
-	std::vector<std::unique_ptr<Component>>& getComponentVector();
+	ComponentView<T> getComponentView();
+
+	/**
+	 * \brief Get the spatial index of every entity with a Transform, brought up to date first. Only transforms
+	 * changed since the last call are moved, except with the archetype storage which doesn't track changes.
+	 * Needs read access to Transform, entities moved by the caller afterwards keep their old position in the
+	 * index until the next call. Removed transforms leave the index when the observers are flushed, until then
+	 * it may return entities that no longer have one
+	 * \return The index, safe to query from several threads
+	 */
+	const SpatialIndex& getSpatialIndex();
+
+	/**
+	 * \brief Get the archetype storage, nullptr unless the ARCHETYPES backend is used
+	 * \return Pointer to the archetype storage
+	 */
+	ArchetypeStorage* getArchetypeStorage() const;
+
+	StorageBackendEnum getStorageBackend() const;
+
+	ThreadPool& getThreadPool() const;
 
 	/**
 	 * \brief Get the amount of entities
@@ -76,63 +328,1587 @@ public:
 	 */
 	uint32_t getNumActiveEntities() const;
 
+	/**
+	 * \brief Get the current change tick, components that are set or passed mutably are marked with it.
+	 * See query.h for the Changed and Added filters
+	 */
+	uint32_t getChangeTick() const;
+
 	/**
 	 * \brief Get the entity at a certain index
 	 * \param idx Index
-	 * \return The entity at that index, invalid entity if idx is out of bounds
+	 * \return The entity at that index, invalid entity if idx is out of bounds or the entity was destroyed
 	 */
 	Entity getEntityByIdx(uint32_t idx);
 
+	/**
+	 * \brief Get the entity a handle stored in a component points at
+	 * \param handle Handle, see Entity::getHandle
+	 * \return The entity, invalid entity if the handle is null or the entity was destroyed
+	 */
+	Entity getEntity(EntityHandle handle);
+
+	/**
+	 * \brief Whether the entity a handle points at still exists
+	 */
+	bool isValid(EntityHandle handle) const;
+
+	/**
+	 * \brief Get the id of a tag, adding it if it doesn't exist yet. Ids stay the same for the lifetime of the ECS,
+	 * so they can be looked up once and kept
+	 * \param tag Tag name
+	 * \return Tag id
+	 */
+	uint32_t internTag(const std::string& tag);
+
+	/**
+	 * \brief Get the id of a tag without adding it
+	 * \return Tag id, NO_TAG if no entity ever had the tag
+	 */
+	uint32_t findTag(const std::string& tag) const;
+
+	const std::string& getTagName(uint32_t tag) const;
+
+	/**
+	 * \brief Get an entity with a tag in O(1)
+	 * \param tag Tag id
+	 * \return The entity, invalid entity if no entity has the tag
+	 */
+	Entity findEntityWithTag(uint32_t tag);
+	Entity findEntityWithTag(const std::string& tag);
+
+	/**
+	 * \brief Get the indices of the entities with a tag, in no particular order
+	 * \param tag Tag id
+	 * \return Entity indices, invalidated when an entity is created or destroyed or a tag is set
+	 */
+	Span<const uint32_t> getEntitiesWithTag(uint32_t tag) const;
+
+	/**
+	 * \brief Find every entity with a tag without allocating once the vector has grown large enough
+	 * \param tag Tag name
+	 * \param entities Cleared, then filled with the entities
+	 */
+	void findEntitiesWithTag(const std::string& tag, std::vector<Entity>& entities);
+
 	std::vector<Entity> findEntitiesWithTag(const std::string& tag);
+
+	static constexpr uint32_t NO_TAG      = 0xFFFFFFFF;
+	static constexpr uint32_t DEFAULT_TAG = 0; // "entity"
 private:
 	friend class Entity;
+	friend class Prefab;
+	friend class SystemScheduler;
 
-	uint32_t m_numEntities = 0;
+	template <typename T, typename Checks>
+	friend class ComponentRef;
 
-	std::unordered_map<std::type_index, std::vector<std::unique_ptr<Component>>> m_components;
+	/**
+	 * \brief Start a new change tick, every system update and every update's sync point gets its own tick
+	 * \return The new tick
+	 */
+	uint32_t advanceChangeTick();
 
-	std::vector<uint32_t> m_versions;
-	std::vector<std::string> m_tags;
+	/**
+	 * \brief Get the tick the Changed and Added filters of a query on the current thread compare against
+	 */
+	uint32_t getQueryTick() const;
 
-	std::unordered_set<uint32_t> m_availableIds;
+	// Entities that have every owned component are in slots [0, size) of every owned pool, in the same order
+	struct Group final
+	{
+		uint64_t owned; // Signature bits of the owned components
+		std::vector<ComponentPoolBase*> pools;
+		uint32_t size;
+	};
 
-	std::vector<std::unique_ptr<System>> m_systems;
-};
+	static constexpr uint32_t NO_GROUP = 0xFFFFFFFF;
 
-template <typename T>
-void EntityComponentSystem::addSystem()
-{
-	static_assert(std::is_base_of<System, T>::value, "T must have base class of type System");
+	/**
+	 * \brief Move an entity into a group if it has every owned component, after one of them was added
+	 */
+	void enterGroup(uint32_t idx, Group& group);
 
-	m_systems.emplace_back(std::make_unique<T>());
-}
+	/**
+	 * \brief Move an entity out of a group if it's in it, before an owned component is removed
+	 */
+	void leaveGroup(uint32_t idx, Group& group);
 
-template <typename T>
-void EntityComponentSystem::registerComponent()
-{
-	static_assert(std::is_base_of<Component, T>::value, "T must have base class of type Component");
+	/**
+	 * \brief Find the smallest group whose owned components are all required by a query
+	 * \param include Signature bits the query requires
+	 * \return Pointer to the group, nullptr if there's none
+	 */
+	const Group* findGroup(uint64_t include) const;
 
-	// Only register component if it doesn't already exist
-	if (!isComponentRegistered<T>())
+	/**
+	 * \brief Packed entities a query with component pools walks instead of every entity
+	 * \tparam N Amount of query terms
+	 */
+	template <size_t N>
+	struct PoolDriver final
 	{
-		m_components[typeid(T)] = std::vector<std::unique_ptr<Component>>(m_numEntities);
-	}
-}
+		Span<const uint32_t> entities;
+		std::array<bool, N> bySlot; // Terms whose components are stored in the same order as the entities
+	};
 
-template <typename T>
-bool EntityComponentSystem::isComponentRegistered()
-{
-	const auto result = m_components.find(typeid(T)) != m_components.end();
-	return result;
-}
+	struct Observer final
+	{
+		uint32_t id;
+		ObserverFunc func;
+	};
 
-template <typename T>
-std::vector<std::unique_ptr<Component>>& EntityComponentSystem::getComponentVector()
-{
-	if (!isComponentRegistered<T>())
+	// A component was added to or removed from an entity, the version is the one of the entity's handle
+	struct ComponentEvent final
 	{
-		LOG_FATAL << typeid(T).name() << " is not a registered Component";
-	}
+		uint32_t idx;
+		uint32_t version;
+		bool added;
+	};
+
+	struct ObservedComponent final
+	{
+		bool (*hasComponent)(EntityComponentSystem& ecs, uint32_t idx);
+		std::vector<Observer> onAdd;
+		std::vector<Observer> onRemove;
+		std::vector<ComponentEvent> events;
+	};
+
+	// Entities referencing others through a handle field of a component, see onReferenceDestroyed
+	struct ReferenceIndex final
+	{
+		uint32_t componentId;
+		EntityReferences references;
+		std::function<EntityHandle(const void* component)> readField;
+		std::function<void(EntityReferences& references)> readAll; // After registering and compacting
+		std::vector<Observer> observers;
+	};
+
+	/**
+	 * \brief Find the observers of a component
+	 * \return Pointer to the observers, nullptr if the component was never observed
+	 */
+	template <typename T>
+	ObservedComponent* findObservedComponent();
+
+	template <typename T>
+	ObservedComponent& getObservedComponent();
+
+	/**
+	 * \brief Pass a batch of entities to observers
+	 */
+	void notifyObservers(const std::vector<Observer>& observers, const ComponentEvent* events, size_t count);
+
+	/**
+	 * \brief Pass the entities that referenced destroyed entities to the observers of a reference index
+	 * \param destroyed The destroyed entities
+	 */
+	void notifyReferrers(ReferenceIndex& index, const std::vector<ComponentEvent>& destroyed);
+
+	/**
+	 * \brief Read the handle field of every component into a reference index
+	 */
+	template <typename T>
+	void readReferences(EntityReferences& references, EntityHandle T::*field);
+
+	/**
+	 * \brief Update the reference indices of a component that was just set
+	 */
+	template <typename T>
+	void indexReferences(uint32_t idx, const T& component);
+
+	/**
+	 * \brief Find the pool of a component
+	 * \tparam T Component type
+	 * \return Pointer to the pool if the component is registered, otherwise nullptr
+	 */
+	template <typename T>
+	ComponentPool<T>* findComponentPool();
+
+	/**
+	 * \brief Find the counter that changes whenever components of a type may have moved, see ComponentRef
+	 * \return Pointer to the counter, nullptr if the component isn't registered
+	 */
+	template <typename T>
+	const uint32_t* findLayoutVersion();
+
+	/**
+	 * \brief Find the tick the component of an entity was last changed at
+	 * \return Pointer to the tick, nullptr if the entity doesn't have the component or changes aren't tracked
+	 */
+	template <typename T>
+	uint32_t* findChangedTick(uint32_t idx);
+
+	/**
+	 * \brief getComponentView without the access check, for queries that check their own access
+	 */
+	template <typename T>
+	ComponentView<T> findComponentView();
+
+	/**
+	 * \brief Find the view of a query term's component
+	 * \return The view, an empty view if the component isn't registered since no entity can have it
+	 */
+	template <typename T>
+	ComponentView<T> findQueryView();
+
+	/**
+	 * \brief Find the component of an entity in whichever storage backend is used. The component is
+	 * marked as changed unless T is const
+	 * \return Pointer to the component, nullptr if the entity doesn't have it or it isn't registered
+	 */
+	template <typename T>
+	T* findComponent(uint32_t idx);
+
+	/**
+	 * \brief Find the bit of a component in the entity signatures of the component pools
+	 * \return The bit, ArchetypeStorage::NO_COMPONENT if the component isn't registered
+	 */
+	template <typename T>
+	uint32_t findComponentBit() const;
+
+	/**
+	 * \brief Set the component of an entity in whichever storage backend is used
+	 * \return False if the component isn't registered
+	 */
+	template <typename T>
+	bool setComponent(uint32_t idx, const T& component);
+
+	/**
+	 * \brief Remove the component of an entity in whichever storage backend is used
+	 * \return False if the component isn't registered
+	 */
+	template <typename T>
+	bool removeComponent(uint32_t idx);
+
+	/**
+	 * \brief Add a prefab's component to entities that were just created by createEntities and don't have it.
+	 * With the archetype storage the entities must already be in an archetype with the component
+	 * \return False if the component isn't registered
+	 */
+	template <typename T>
+	bool addPrefabComponent(Span<const uint32_t> indices, const T& component);
+
+	template <typename... Qs, typename Func, size_t... Is>
+	void eachInPools(Func& func, std::index_sequence<Is...>);
+
+	template <typename... Qs, typename Func, size_t... Is>
+	void eachInArchetypes(Func& func, std::index_sequence<Is...>);
+
+	template <typename... Qs, typename Func, size_t... Is>
+	void eachSpanInPools(Func& func, std::index_sequence<Is...>);
+
+	template <typename... Qs, typename Func, size_t... Is>
+	void eachSpanInArchetypes(Func& func, std::index_sequence<Is...>);
+
+	template <typename... Qs, typename Func, size_t... Is>
+	void parallelEachInPools(Func& func, std::index_sequence<Is...>);
+
+	template <typename... Qs, typename Func, size_t... Is>
+	void parallelEachInArchetypes(Func& func, std::index_sequence<Is...>);
+
+	/**
+	 * \brief Get the signature bits a query with component pools cares about and the ones it requires,
+	 * an entity matches if (signature & care) == include
+	 * \return False if the query can't match anything
+	 */
+	template <typename... Qs>
+	bool getPoolMasks(uint64_t& care, uint64_t& include) const;
+
+	/**
+	 * \brief Get the entity sets a query with component pools has to match, see EntityBitset::forEachMatch
+	 * \param include Sets of the required components, the set of every entity if none are required
+	 * \param exclude Sets of the excluded components
+	 * \return False if the query can't match anything
+	 */
+	template <typename... Qs>
+	bool getPoolBitsets(std::array<const EntityBitset*, sizeof...(Qs) + 1>& include, uint32_t& num_include,
+	                    std::array<const EntityBitset*, sizeof...(Qs)>& exclude, uint32_t& num_exclude) const;
+
+	/**
+	 * \brief Check the Changed and Added filters of a query for an entity that has the query's components
+	 * \param slot Slot of the entity's components in the terms read by slot, see PoolDriver
+	 * \param since Tick from getQueryTick
+	 */
+	template <typename... Qs, typename Views, size_t... Is>
+	static bool passesChangeFilters(const Views& views, uint32_t idx, uint32_t slot,
+	                                const std::array<bool, sizeof...(Qs)>& by_slot, uint32_t since,
+	                                std::index_sequence<Is...>);
+
+	/**
+	 * \brief Mark the components a query passes mutably as changed for an entity that matches the query
+	 * \param tick Tick from getChangeTick
+	 */
+	template <typename... Qs, typename Views, size_t... Is>
+	static void markQueryWrites(const Views& views, uint32_t idx, uint32_t slot,
+	                            const std::array<bool, sizeof...(Qs)>& by_slot, uint32_t tick,
+	                            std::index_sequence<Is...>);
+
+	/**
+	 * \brief Get the arguments a query passes to its function for an entity that matches the query
+	 */
+	template <typename... Qs, typename Views, size_t... Is>
+	static auto getQueryArgs(const Views& views, uint32_t idx, uint32_t slot,
+	                         const std::array<bool, sizeof...(Qs)>& by_slot, std::index_sequence<Is...>);
+
+	/**
+	 * \brief Find the packed entities a query has to visit, either a group whose owned components are all
+	 * required or the smallest sparse set pool of a required component, whichever has fewer entities
+	 * \param include Signature bits the query requires
+	 * \return False if the query has to look at every entity
+	 */
+	template <typename... Qs, typename Views, size_t... Is>
+	bool findPoolDriver(const Views& views, uint64_t include, PoolDriver<sizeof...(Qs)>& driver,
+	                    std::index_sequence<Is...>) const;
+
+	/**
+	 * \brief Get a pointer to the column of every component of a query in an archetype chunk,
+	 * nullptr for filters and optional components the archetype doesn't have
+	 */
+	template <typename... Qs, size_t... Is>
+	static auto getArchetypeColumns(const Archetype& archetype, uint32_t chunk,
+	                                const std::array<uint32_t, sizeof...(Qs)>& ids, std::index_sequence<Is...>);
+
+	/**
+	 * \brief In debug builds, log a fatal error if the system being updated on this thread accesses a
+	 * component it didn't declare
+	 * \param write Whether or not the component is accessed mutably
+	 */
+	template <typename T>
+	void checkAccess(bool write) const;
+
+	template <typename... Qs>
+	void checkQueryAccess() const;
+
+	/**
+	 * \brief In debug builds, log a fatal error if the system being updated on this thread makes a structural
+	 * change without exclusive access
+	 */
+	void checkStructuralChange() const;
+
+	/**
+	 * \brief Create the entities reserved since the last time, and remove the reserved ids from the free ids
+	 */
+	void createReservedEntities();
 
-	return m_components.at(typeid(T));
+	/**
+	 * \brief Move the entities whose Transform changed since the last sync in the spatial index and rebuild it
+	 */
+	void syncSpatialIndex();
+
+	/**
+	 * \brief Move an entity to another tag's entity list
+	 */
+	void setTag(uint32_t idx, uint32_t tag);
+	void addToTag(uint32_t idx, uint32_t tag);
+	void removeFromTag(uint32_t idx);
+
+	/**
+	 * \brief Get the include and exclude masks of a query from the bit of each of its components, used for
+	 * archetype signatures and entity signatures
+	 * \return False if the query can't match anything
+	 */
+	template <typename... Qs>
+	static bool getArchetypeMasks(const std::array<uint32_t, sizeof...(Qs)>& ids, uint64_t& include,
+	                              uint64_t& exclude);
+
+	uint32_t m_numEntities = 0;
+
+	// 0, 1, 2... used as the entity span of eachSpan with component pools
+	std::vector<uint32_t> m_entityIndices;
+
+	// Indexed by component id, nullptr if the component isn't registered
+	std::vector<std::unique_ptr<ComponentPoolBase>> m_components;
+
+	// Components of every entity with component pools, one bit per component in the order they were registered
+	std::vector<uint64_t> m_signatures;
+	std::vector<uint32_t> m_componentBits; // Indexed by component id
+
+	// Entities that have each component with component pools, indexed by component bit
+	std::vector<EntityBitset> m_componentEntities;
+
+	std::vector<Group> m_groups;
+	std::vector<uint32_t> m_componentGroups; // Group owning each component, indexed by component bit
+
+	// Indices that hold an entity, i.e. weren't destroyed or only reserved
+	EntityBitset m_alive;
+
+	std::vector<uint32_t> m_createdIndices; // Entities created by createEntities, kept to reuse its memory
+
+	// Entities with a Transform. Removals are passed on by an onRemove observer, transforms are synced and the
+	// index rebuilt when it's next used
+	SpatialIndex m_spatialIndex;
+	uint32_t m_spatialIndexTick = 0; // Tick of the last sync, 0 if every transform has to be added
+	std::mutex m_spatialIndexMutex;
+
+	// Indexed by component id, nullptr if the component isn't observed
+	std::vector<std::unique_ptr<ObservedComponent>> m_observedComponents;
+	std::vector<Observer> m_onDestroy;
+	std::vector<ComponentEvent> m_destroyEvents;
+	std::vector<Entity> m_observedEntities; // Passed to observers, kept to reuse its memory
+	uint32_t m_nextObserverId = 0;
+
+	std::vector<std::unique_ptr<ReferenceIndex>> m_referenceIndices;
+	std::vector<ComponentEvent> m_referencedDestroyEvents; // Destroyed entities to look up in the reference indices
+	std::vector<ComponentEvent> m_referrerEvents;          // Passed to notifyObservers, kept to reuse its memory
+	std::mutex m_referenceMutex;                           // Components may be set from parallel loops
+
+	// Advanced whenever a system starts, see advanceChangeTick. Tick 0 is before anything happened
+	std::atomic<uint32_t> m_changeTick{1};
+	uint32_t m_updateTick = 0; // Tick the last update started at
+
+	std::unique_ptr<ArchetypeStorage> m_archetypes = nullptr;
+	uint32_t m_archetypeLayoutVersion = 1; // Changes whenever archetype rows move, see findLayoutVersion
+
+	// Version of every entity index. Destroyed entities form a free list through nextFree
+	struct EntitySlot final
+	{
+		uint32_t version;
+		uint32_t nextFree;
+	};
+
+	static constexpr uint32_t FREE_LIST_END = 0xFFFFFFFF;
+	static constexpr uint32_t NOT_FREE      = 0xFFFFFFFE;
+
+	std::vector<EntitySlot> m_slots;
+
+	// Reserving pops ids off the free list. The links aren't changed while ids are being reserved since ids
+	// are only freed while nothing is being reserved, so popping can't run into ABA
+	std::atomic<uint32_t> m_freeHead{FREE_LIST_END};
+
+	// Head of the free list the last time reserved entities were created, the ids from here up to
+	// m_freeHead have been reserved since
+	uint32_t m_createdFreeHead = FREE_LIST_END;
+	uint32_t m_numFreeIds      = 0;
+
+	// Entities up to here have been reserved, the ones past m_numEntities haven't been created yet
+	std::atomic<uint32_t> m_numReservedEntities{0};
+
+	// Interned tags and the entities of every tag
+	std::unordered_map<std::string, uint32_t> m_tagIds;
+	std::vector<std::string> m_tagNames;
+	std::vector<std::vector<uint32_t>> m_taggedEntities;
+
+	// Tag of every entity and where it is in the tag's entity list
+	struct EntityTag final
+	{
+		uint32_t tag;
+		uint32_t slot;
+	};
+
+	std::vector<EntityTag> m_entityTags;
+
+	// Command buffers in the order their threads first asked for one
+	std::vector<std::unique_ptr<CommandBuffer>> m_commandBuffers;
+	std::unordered_map<std::thread::id, CommandBuffer*> m_threadCommandBuffers;
+	std::mutex m_commandBuffersMutex;
+
+	// Never reused, identifies this ECS in each thread's cached command buffer
+	uint64_t m_instanceId;
+
+	std::vector<std::unique_ptr<System>> m_systems;
+	std::unique_ptr<SystemScheduler> m_scheduler;
+	bool m_systemsChanged = false;
+
+	std::unique_ptr<ThreadPool> m_threadPool;
+};
+
+template <typename T>
+void EntityComponentSystem::addSystem()
+{
+	static_assert(std::is_base_of<System, T>::value, "T must have base class of type System");
+
+	m_systems.emplace_back(std::make_unique<T>());
+	m_systems.back()->init(*this);
+	m_systemsChanged = true;
+}
+
+template <typename Func>
+void EntityComponentSystem::entityLoop(Func&& entity_func) const
+{
+	m_alive.forEach(entity_func);
+}
+
+template <typename Func>
+void EntityComponentSystem::parallelEntityLoop(Func&& entity_func)
+{
+	const auto numEntities = m_numEntities;
+	m_threadPool->parallelFor((numEntities + PARALLEL_CHUNK_SIZE - 1) / PARALLEL_CHUNK_SIZE, [&](uint32_t chunk)
+	{
+		const EntityBitset* alive = &m_alive;
+		EntityBitset::forEachMatch(&alive, 1, nullptr, 0, chunk * PARALLEL_CHUNK_SIZE,
+		                           std::min(numEntities, (chunk + 1) * PARALLEL_CHUNK_SIZE), entity_func);
+	});
+}
+
+template <typename... Qs, typename Func>
+void EntityComponentSystem::each(Func&& func)
+{
+	checkQueryAccess<Qs...>();
+
+	if (m_archetypes)
+	{
+		eachInArchetypes<Qs...>(func, std::index_sequence_for<Qs...>());
+	}
+	else
+	{
+		eachInPools<Qs...>(func, std::index_sequence_for<Qs...>());
+	}
+}
+
+template <typename... Qs, typename Func>
+void EntityComponentSystem::eachSpan(Func&& func)
+{
+	checkQueryAccess<Qs...>();
+
+	if (m_archetypes)
+	{
+		eachSpanInArchetypes<Qs...>(func, std::index_sequence_for<Qs...>());
+	}
+	else
+	{
+		eachSpanInPools<Qs...>(func, std::index_sequence_for<Qs...>());
+	}
+}
+
+template <typename... Qs, typename Func>
+void EntityComponentSystem::parallelEach(Func&& func)
+{
+	parallelEachChunk<Qs...>([&](uint32_t, uint32_t idx, auto&&... args)
+	{
+		func(idx, args...);
+	});
+}
+
+template <typename... Qs, typename Func>
+void EntityComponentSystem::parallelEachChunk(Func&& func)
+{
+	checkQueryAccess<Qs...>();
+
+	if (m_archetypes)
+	{
+		parallelEachInArchetypes<Qs...>(func, std::index_sequence_for<Qs...>());
+	}
+	else
+	{
+		parallelEachInPools<Qs...>(func, std::index_sequence_for<Qs...>());
+	}
+}
+
+template <typename... Qs>
+uint32_t EntityComponentSystem::getNumParallelChunks()
+{
+	if (m_archetypes)
+	{
+		const std::array<uint32_t, sizeof...(Qs)> ids = {
+			m_archetypes->findComponentId<typename QueryTerm<Qs>::Component>()...
+		};
+
+		uint64_t include = 0;
+		uint64_t exclude = 0;
+		if (!getArchetypeMasks<Qs...>(ids, include, exclude))
+		{
+			return 0;
+		}
+
+		uint32_t numChunks = 0;
+		m_archetypes->forEachChunk(include, exclude, [&](const Archetype&, uint32_t, uint32_t) { ++numChunks; });
+		return numChunks;
+	}
+
+	uint64_t care    = 0;
+	uint64_t include = 0;
+	if (!getPoolMasks<Qs...>(care, include))
+	{
+		return 0;
+	}
+
+	const auto views = std::make_tuple(findQueryView<typename QueryTerm<Qs>::Component>()...);
+
+	PoolDriver<sizeof...(Qs)> driver;
+	const auto count = findPoolDriver<Qs...>(views, include, driver, std::index_sequence_for<Qs...>())
+		                   ? driver.entities.size()
+		                   : m_numEntities;
+	return (count + PARALLEL_CHUNK_SIZE - 1) / PARALLEL_CHUNK_SIZE;
+}
+
+template <typename... Qs, typename T, typename Func, typename Combine>
+T EntityComponentSystem::parallelReduce(T identity, Func&& func, Combine&& combine)
+{
+	// Padded so that work items accumulating on different threads don't share cache lines
+	std::vector<CacheLinePadded<T>> partials(getNumParallelChunks<Qs...>(), CacheLinePadded<T>{identity});
+
+	parallelEachChunk<Qs...>([&](uint32_t chunk, uint32_t idx, auto&&... args)
+	{
+		func(partials[chunk].value, idx, args...);
+	});
+
+	auto result = identity;
+	for (const auto& partial : partials)
+	{
+		result = combine(result, partial.value);
+	}
+	return result;
+}
+
+template <typename T>
+void EntityComponentSystem::registerComponent(ComponentStorageEnum storage)
+{
+	static_assert(std::is_base_of<Component, T>::value, "T must have base class of type Component");
+
+	// Archetypes always keep components packed, so the storage policy only applies to pools
+	if (m_archetypes)
+	{
+		m_archetypes->registerComponent<T>();
+		return;
+	}
+
+	// Only register component if it doesn't already exist
+	if (isComponentRegistered<T>())
+	{
+		return;
+	}
+
+	if (m_componentEntities.size() >= 64)
+	{
+		LOG_FATAL << "Component pools support at most 64 components";
+		return;
+	}
+
+	const auto id = ComponentId::get<T>();
+	if (id >= m_components.size())
+	{
+		m_components.resize(id + 1);
+		m_componentBits.resize(id + 1, ArchetypeStorage::NO_COMPONENT);
+	}
+	m_components[id]    = std::make_unique<ComponentPool<T>>(m_numEntities, storage);
+	m_componentBits[id] = static_cast<uint32_t>(m_componentEntities.size());
+	m_componentEntities.emplace_back();
+	m_componentEntities.back().resize(m_numEntities);
+	m_componentGroups.push_back(NO_GROUP);
+}
+
+template <typename... Ts>
+void EntityComponentSystem::addGroup()
+{
+	static_assert(sizeof...(Ts) > 0, "A group needs at least one component");
+
+	if (m_archetypes)
+	{
+		return;
+	}
+
+	const std::array<ComponentPoolBase*, sizeof...(Ts)> pools = {findComponentPool<Ts>()...};
+	const std::array<bool, sizeof...(Ts)> sparse = {
+		(findComponentPool<Ts>() && findComponentPool<Ts>()->getStorage() == ComponentStorageEnum::SPARSE_SET)...
+	};
+	const std::array<uint32_t, sizeof...(Ts)> bits = {findComponentBit<Ts>()...};
+
+	Group group = {0, {}, 0};
+	for (size_t i = 0; i < bits.size(); ++i)
+	{
+		if (!sparse[i])
+		{
+			throw std::runtime_error("Group components must be registered as SPARSE_SET");
+		}
+		if (m_componentGroups[bits[i]] != NO_GROUP || (group.owned >> bits[i] & 1))
+		{
+			throw std::runtime_error("A component can only be owned by one group");
+		}
+
+		group.owned |= 1ull << bits[i];
+		group.pools.push_back(pools[i]);
+	}
+
+	for (const auto bit : bits)
+	{
+		m_componentGroups[bit] = static_cast<uint32_t>(m_groups.size());
+	}
+	m_groups.push_back(std::move(group));
+
+	// Gather the entities that already have every owned component
+	m_alive.forEach([&](uint32_t idx)
+	{
+		enterGroup(idx, m_groups.back());
+	});
+}
+
+template <typename T>
+bool EntityComponentSystem::isComponentRegistered()
+{
+	if (m_archetypes)
+	{
+		return m_archetypes->isComponentRegistered<T>();
+	}
+
+	return findComponentPool<T>() != nullptr;
+}
+
+template <typename T>
+ComponentView<T> EntityComponentSystem::getComponentView()
+{
+	checkAccess<T>(true);
+
+	return findComponentView<T>();
+}
+
+template <typename T>
+ComponentView<T> EntityComponentSystem::findComponentView()
+{
+	if (m_archetypes)
+	{
+		LOG_FATAL << "Component views are not available with archetype storage";
+	}
+
+	const auto pool = findComponentPool<T>();
+	if (!pool)
+	{
+		LOG_FATAL << typeid(T).name() << " is not a registered Component";
+		throw std::runtime_error("Component is not registered");
+	}
+
+	return pool->getView();
+}
+
+template <typename T>
+ComponentView<T> EntityComponentSystem::findQueryView()
+{
+	const auto pool = findComponentPool<T>();
+	return pool ? pool->getView() : ComponentView<T>();
+}
+
+template <typename T>
+ComponentPool<T>* EntityComponentSystem::findComponentPool()
+{
+	const auto id = ComponentId::get<T>();
+	return id < m_components.size() ? static_cast<ComponentPool<T>*>(m_components[id].get()) : nullptr;
+}
+
+template <typename T>
+const uint32_t* EntityComponentSystem::findLayoutVersion()
+{
+	// Any structural change can move components between archetypes
+	if (m_archetypes)
+	{
+		return m_archetypes->isComponentRegistered<T>() ? &m_archetypeLayoutVersion : nullptr;
+	}
+
+	const auto pool = findComponentPool<T>();
+	return pool ? &pool->getLayoutVersion() : nullptr;
+}
+
+template <typename T>
+uint32_t* EntityComponentSystem::findChangedTick(uint32_t idx)
+{
+	if (m_archetypes)
+	{
+		return nullptr;
+	}
+
+	const auto pool = findComponentPool<T>();
+	return pool ? pool->findChangedTick(idx) : nullptr;
+}
+
+template <typename T>
+uint32_t EntityComponentSystem::findComponentBit() const
+{
+	const auto id = ComponentId::get<T>();
+	return id < m_componentBits.size() ? m_componentBits[id] : ArchetypeStorage::NO_COMPONENT;
+}
+
+template <typename T>
+uint32_t EntityComponentSystem::onAdd(ObserverFunc func)
+{
+	const auto id = m_nextObserverId++;
+	getObservedComponent<T>().onAdd.push_back({id, std::move(func)});
+	return id;
+}
+
+template <typename T>
+uint32_t EntityComponentSystem::onRemove(ObserverFunc func)
+{
+	const auto id = m_nextObserverId++;
+	getObservedComponent<T>().onRemove.push_back({id, std::move(func)});
+	return id;
+}
+
+template <typename T>
+uint32_t EntityComponentSystem::onReferenceDestroyed(EntityHandle T::*field, ObserverFunc func)
+{
+	static_assert(std::is_base_of<Component, T>::value, "T must have based class of type Component");
+
+	auto index         = std::make_unique<ReferenceIndex>();
+	index->componentId = ComponentId::get<T>();
+	index->readField   = [field](const void* component)
+	{
+		return static_cast<const T*>(component)->*field;
+	};
+	index->readAll = [this, field](EntityReferences& references)
+	{
+		readReferences<T>(references, field);
+	};
+	index->readAll(index->references);
+
+	const auto id = m_nextObserverId++;
+	index->observers.push_back({id, std::move(func)});
+	m_referenceIndices.push_back(std::move(index));
+	return id;
+}
+
+template <typename T>
+bool EntityComponentSystem::setReference(uint32_t idx, EntityHandle T::*field, EntityHandle target)
+{
+	checkAccess<T>(true);
+
+	const auto component = findComponent<T>(idx);
+	if (!component)
+	{
+		return false;
+	}
+
+	component->*field = target;
+	indexReferences<T>(idx, *component);
+	return true;
+}
+
+template <typename T>
+void EntityComponentSystem::readReferences(EntityReferences& references, EntityHandle T::*field)
+{
+	if (m_archetypes)
+	{
+		m_archetypes->each<T>([&](uint32_t idx, const T& component)
+		{
+			references.set(idx, component.*field);
+		});
+		return;
+	}
+
+	if (!findComponentPool<T>())
+	{
+		return;
+	}
+
+	const auto view = findComponentView<T>();
+	for (uint32_t n = 0; n < view.size(); ++n)
+	{
+		if (view.hasSlot(n))
+		{
+			references.set(view.entityAt(n), view.slot(n).*field);
+		}
+	}
+}
+
+template <typename T>
+void EntityComponentSystem::indexReferences(uint32_t idx, const T& component)
+{
+	for (auto& index : m_referenceIndices)
+	{
+		if (index->componentId == ComponentId::get<T>())
+		{
+			std::lock_guard<std::mutex> lock(m_referenceMutex);
+			index->references.set(idx, index->readField(&component));
+		}
+	}
+}
+
+template <typename T>
+EntityComponentSystem::ObservedComponent* EntityComponentSystem::findObservedComponent()
+{
+	const auto id = ComponentId::get<T>();
+	return id < m_observedComponents.size() ? m_observedComponents[id].get() : nullptr;
+}
+
+template <typename T>
+EntityComponentSystem::ObservedComponent& EntityComponentSystem::getObservedComponent()
+{
+	const auto id = ComponentId::get<T>();
+	if (id >= m_observedComponents.size())
+	{
+		m_observedComponents.resize(id + 1);
+	}
+
+	auto& observed = m_observedComponents[id];
+	if (!observed)
+	{
+		observed = std::make_unique<ObservedComponent>();
+		observed->hasComponent = [](EntityComponentSystem& ecs, uint32_t idx)
+		{
+			return ecs.findComponent<const T>(idx) != nullptr;
+		};
+	}
+	return *observed;
+}
+
+template <typename T>
+T* EntityComponentSystem::findComponent(uint32_t idx)
+{
+	using Type = std::remove_const_t<T>;
+
+	// The component is often only read, but it's handed out mutably so writes through it aren't caught
+	checkAccess<Type>(false);
+
+	if (m_archetypes)
+	{
+		return m_archetypes->get<Type>(idx);
+	}
+
+	const auto pool = findComponentPool<Type>();
+	if (!pool)
+	{
+		return nullptr;
+	}
+
+	const auto component = pool->get(idx);
+	if (component && !std::is_const<T>::value)
+	{
+		pool->markChanged(idx, getChangeTick());
+	}
+	return component;
+}
+
+template <typename T>
+bool EntityComponentSystem::setComponent(uint32_t idx, const T& component)
+{
+	checkAccess<T>(true);
+#ifndef NDEBUG
+	if (!findComponent<const T>(idx))
+	{
+		checkStructuralChange();
+	}
+#endif
+
+	// Only look up whether the component is being added if someone is listening
+	const auto observed = findObservedComponent<T>();
+	if (observed && !findComponent<const T>(idx))
+	{
+		observed->events.push_back({idx, m_slots[idx].version, true});
+	}
+
+	if (m_archetypes)
+	{
+		// Overwriting a component the entity already has doesn't move any rows, so component refs stay valid
+		if (!findComponent<const T>(idx))
+		{
+			++m_archetypeLayoutVersion;
+		}
+		if (!m_archetypes->set<T>(idx, component))
+		{
+			return false;
+		}
+		indexReferences<T>(idx, component);
+		return true;
+	}
+
+	const auto pool = findComponentPool<T>();
+	if (!pool)
+	{
+		return false;
+	}
+
+	const auto bit   = findComponentBit<T>();
+	const auto added = !(m_signatures[idx] >> bit & 1);
+	pool->set(idx, component, getChangeTick());
+	m_signatures[idx] |= 1ull << bit;
+	m_componentEntities[bit].set(idx);
+
+	if (added && m_componentGroups[bit] != NO_GROUP)
+	{
+		enterGroup(idx, m_groups[m_componentGroups[bit]]);
+	}
+	indexReferences<T>(idx, component);
+	return true;
+}
+
+template <typename T>
+bool EntityComponentSystem::removeComponent(uint32_t idx)
+{
+	checkStructuralChange();
+
+	for (auto& index : m_referenceIndices)
+	{
+		if (index->componentId == ComponentId::get<T>())
+		{
+			index->references.remove(idx);
+		}
+	}
+
+	const auto observed = findObservedComponent<T>();
+	if (observed && findComponent<const T>(idx))
+	{
+		observed->events.push_back({idx, m_slots[idx].version, false});
+	}
+
+	if (m_archetypes)
+	{
+		if (findComponent<const T>(idx))
+		{
+			++m_archetypeLayoutVersion;
+		}
+		return m_archetypes->remove<T>(idx);
+	}
+
+	const auto pool = findComponentPool<T>();
+	if (!pool)
+	{
+		return false;
+	}
+
+	const auto bit = findComponentBit<T>();
+	if (m_componentGroups[bit] != NO_GROUP)
+	{
+		leaveGroup(idx, m_groups[m_componentGroups[bit]]);
+	}
+
+	pool->remove(idx);
+	m_signatures[idx] &= ~(1ull << bit);
+	m_componentEntities[bit].reset(idx);
+	return true;
+}
+
+template <typename T>
+bool EntityComponentSystem::addPrefabComponent(Span<const uint32_t> indices, const T& component)
+{
+	checkAccess<T>(true);
+
+	if (m_archetypes)
+	{
+		if (!m_archetypes->isComponentRegistered<T>())
+		{
+			return false;
+		}
+		m_archetypes->initComponents<T>(indices, component);
+	}
+	else
+	{
+		const auto pool = findComponentPool<T>();
+		if (!pool)
+		{
+			return false;
+		}
+
+		const auto bit = findComponentBit<T>();
+		pool->addMany(indices, component, getChangeTick());
+		for (const auto idx : indices)
+		{
+			m_signatures[idx] |= 1ull << bit;
+			m_componentEntities[bit].set(idx);
+		}
+
+		if (m_componentGroups[bit] != NO_GROUP)
+		{
+			auto& group = m_groups[m_componentGroups[bit]];
+			for (const auto idx : indices)
+			{
+				enterGroup(idx, group);
+			}
+		}
+	}
+
+	if (const auto observed = findObservedComponent<T>())
+	{
+		for (const auto idx : indices)
+		{
+			observed->events.push_back({idx, m_slots[idx].version, true});
+		}
+	}
+	if (!m_referenceIndices.empty())
+	{
+		for (const auto idx : indices)
+		{
+			indexReferences<T>(idx, component);
+		}
+	}
+	return true;
+}
+
+template <typename... Qs, typename Func, size_t... Is>
+void EntityComponentSystem::eachInPools(Func& func, std::index_sequence<Is...>)
+{
+	const auto views = std::make_tuple(findQueryView<typename QueryTerm<Qs>::Component>()...);
+
+	uint64_t care    = 0;
+	uint64_t include = 0;
+	std::array<const EntityBitset*, sizeof...(Qs) + 1> includeSets = {};
+	std::array<const EntityBitset*, sizeof...(Qs)> excludeSets = {};
+	uint32_t numInclude = 0;
+	uint32_t numExclude = 0;
+	if (!getPoolMasks<Qs...>(care, include)
+		|| !getPoolBitsets<Qs...>(includeSets, numInclude, excludeSets, numExclude))
+	{
+		return;
+	}
+
+	const auto since = getQueryTick();
+	const auto tick  = getChangeTick();
+	const auto visit = [&](uint32_t idx, uint32_t slot, const std::array<bool, sizeof...(Qs)>& by_slot)
+	{
+		if (!passesChangeFilters<Qs...>(views, idx, slot, by_slot, since, std::index_sequence<Is...>()))
+		{
+			return;
+		}
+
+		markQueryWrites<Qs...>(views, idx, slot, by_slot, tick, std::index_sequence<Is...>());
+		std::apply(func, std::tuple_cat(std::make_tuple(idx),
+		                                getQueryArgs<Qs...>(views, idx, slot, by_slot, std::index_sequence<Is...>())));
+	};
+
+	PoolDriver<sizeof...(Qs)> driver;
+	if (findPoolDriver<Qs...>(views, include, driver, std::index_sequence<Is...>()))
+	{
+		// Back to front so the current entity can be removed from the sparse set
+		for (auto slot = driver.entities.size(); slot-- > 0;)
+		{
+			const auto idx = driver.entities[slot];
+			if ((m_signatures[idx] & care) == include)
+			{
+				visit(idx, slot, driver.bySlot);
+			}
+		}
+		return;
+	}
+
+	const std::array<bool, sizeof...(Qs)> byIdx = {};
+	EntityBitset::forEachMatch(includeSets.data(), numInclude, excludeSets.data(), numExclude, 0, m_numEntities,
+	                           [&](uint32_t idx) { visit(idx, idx, byIdx); });
+}
+
+template <typename... Qs, typename Func, size_t... Is>
+void EntityComponentSystem::eachInArchetypes(Func& func, std::index_sequence<Is...>)
+{
+	const std::array<uint32_t, sizeof...(Qs)> ids = {
+		m_archetypes->findComponentId<typename QueryTerm<Qs>::Component>()...
+	};
+
+	uint64_t include = 0;
+	uint64_t exclude = 0;
+	if (!getArchetypeMasks<Qs...>(ids, include, exclude))
+	{
+		return;
+	}
+
+	m_archetypes->forEachChunk(include, exclude, [&](const Archetype& archetype, uint32_t chunk, uint32_t count)
+	{
+		const auto entities = archetype.getEntities(chunk);
+		const auto columns  = getArchetypeColumns<Qs...>(archetype, chunk, ids, std::index_sequence<Is...>());
+
+		for (uint32_t row = 0; row < count; ++row)
+		{
+			std::apply(func, std::tuple_cat(std::make_tuple(entities[row]),
+			                                QueryTerm<Qs>::getArgs(
+				                                std::get<Is>(columns) ? std::get<Is>(columns) + row : nullptr)...));
+		}
+	});
+}
+
+template <typename... Qs, typename Func, size_t... Is>
+void EntityComponentSystem::eachSpanInPools(Func& func, std::index_sequence<Is...>)
+{
+	const auto views = std::make_tuple(findQueryView<typename QueryTerm<Qs>::Component>()...);
+
+	std::array<const EntityBitset*, sizeof...(Qs) + 1> includeSets = {};
+	std::array<const EntityBitset*, sizeof...(Qs)> excludeSets = {};
+	uint32_t numInclude = 0;
+	uint32_t numExclude = 0;
+	if (!getPoolBitsets<Qs...>(includeSets, numInclude, excludeSets, numExclude))
+	{
+		return;
+	}
+
+	// Runs can only be longer than one entity if every passed component is indexed by entity
+	const auto contiguous = ((!QueryTerm<Qs>::HAS_ARG || !std::get<Is>(views).isPacked()) && ...);
+
+	const auto since = getQueryTick();
+	const auto tick  = getChangeTick();
+	const std::array<bool, sizeof...(Qs)> byIdx = {};
+
+	uint32_t begin = 0;
+	uint32_t end   = 0;
+	const auto visitRun = [&]
+	{
+		if (begin == end)
+		{
+			return;
+		}
+
+		for (auto idx = begin; idx < end; ++idx)
+		{
+			markQueryWrites<Qs...>(views, idx, idx, byIdx, tick, std::index_sequence<Is...>());
+		}
+
+		const auto count = end - begin;
+		std::apply(func, std::tuple_cat(
+			           std::make_tuple(Span<const uint32_t>(m_entityIndices.data() + begin, count)),
+			           QueryTerm<Qs>::getSpanArgs(std::get<Is>(views).get(begin), count)...));
+	};
+
+	// Matching entities are merged into runs, a run is visited once the next match doesn't extend it
+	const auto extendRun = [&](uint32_t idx)
+	{
+		if (!passesChangeFilters<Qs...>(views, idx, idx, byIdx, since, std::index_sequence<Is...>()))
+		{
+			return;
+		}
+
+		if (contiguous && idx == end)
+		{
+			++end;
+			return;
+		}
+
+		visitRun();
+		begin = idx;
+		end   = idx + 1;
+	};
+	EntityBitset::forEachMatch(includeSets.data(), numInclude, excludeSets.data(), numExclude, 0, m_numEntities,
+	                           extendRun);
+	visitRun();
+}
+
+template <typename... Qs, typename Func, size_t... Is>
+void EntityComponentSystem::eachSpanInArchetypes(Func& func, std::index_sequence<Is...>)
+{
+	const std::array<uint32_t, sizeof...(Qs)> ids = {
+		m_archetypes->findComponentId<typename QueryTerm<Qs>::Component>()...
+	};
+
+	uint64_t include = 0;
+	uint64_t exclude = 0;
+	if (!getArchetypeMasks<Qs...>(ids, include, exclude))
+	{
+		return;
+	}
+
+	m_archetypes->forEachChunk(include, exclude, [&](const Archetype& archetype, uint32_t chunk, uint32_t count)
+	{
+		// Filters don't use their column, so With<T> and Without<T> never read it
+		std::apply(func, std::tuple_cat(
+			           std::make_tuple(Span<const uint32_t>(archetype.getEntities(chunk), count)),
+			           QueryTerm<Qs>::getSpanArgs(
+				           QueryTerm<Qs>::HAS_ARG
+					           ? reinterpret_cast<typename QueryTerm<Qs>::Component*>(
+						           archetype.getColumn(chunk, ids[Is]))
+					           : nullptr, count)...));
+	});
+}
+
+template <typename... Qs, typename Func, size_t... Is>
+void EntityComponentSystem::parallelEachInPools(Func& func, std::index_sequence<Is...>)
+{
+	const auto views = std::make_tuple(findQueryView<typename QueryTerm<Qs>::Component>()...);
+
+	uint64_t care    = 0;
+	uint64_t include = 0;
+	std::array<const EntityBitset*, sizeof...(Qs) + 1> includeSets = {};
+	std::array<const EntityBitset*, sizeof...(Qs)> excludeSets = {};
+	uint32_t numInclude = 0;
+	uint32_t numExclude = 0;
+	if (!getPoolMasks<Qs...>(care, include)
+		|| !getPoolBitsets<Qs...>(includeSets, numInclude, excludeSets, numExclude))
+	{
+		return;
+	}
+
+	PoolDriver<sizeof...(Qs)> driver;
+	const auto hasDriver  = findPoolDriver<Qs...>(views, include, driver, std::index_sequence<Is...>());
+	const auto count      = hasDriver ? driver.entities.size() : m_numEntities;
+	const auto signatures = m_signatures.data();
+	const auto since      = getQueryTick();
+	const auto tick       = getChangeTick();
+	const std::array<bool, sizeof...(Qs)> byIdx = {};
+
+	m_threadPool->parallelFor((count + PARALLEL_CHUNK_SIZE - 1) / PARALLEL_CHUNK_SIZE, [&](uint32_t chunk)
+	{
+		const auto visit = [&](uint32_t idx, uint32_t slot, const std::array<bool, sizeof...(Qs)>& by_slot)
+		{
+			if (!passesChangeFilters<Qs...>(views, idx, slot, by_slot, since, std::index_sequence<Is...>()))
+			{
+				return;
+			}
+
+			markQueryWrites<Qs...>(views, idx, slot, by_slot, tick, std::index_sequence<Is...>());
+			std::apply(func, std::tuple_cat(std::make_tuple(chunk, idx),
+			                                getQueryArgs<Qs...>(views, idx, slot, by_slot,
+			                                                    std::index_sequence<Is...>())));
+		};
+
+		const auto begin = chunk * PARALLEL_CHUNK_SIZE;
+		const auto end   = std::min(count, begin + PARALLEL_CHUNK_SIZE);
+		if (hasDriver)
+		{
+			for (auto slot = begin; slot < end; ++slot)
+			{
+				const auto idx = driver.entities[slot];
+				if ((signatures[idx] & care) == include)
+				{
+					visit(idx, slot, driver.bySlot);
+				}
+			}
+			return;
+		}
+
+		EntityBitset::forEachMatch(includeSets.data(), numInclude, excludeSets.data(), numExclude, begin, end,
+		                           [&](uint32_t idx) { visit(idx, idx, byIdx); });
+	});
+}
+
+template <typename... Qs, typename Func, size_t... Is>
+void EntityComponentSystem::parallelEachInArchetypes(Func& func, std::index_sequence<Is...>)
+{
+	const std::array<uint32_t, sizeof...(Qs)> ids = {
+		m_archetypes->findComponentId<typename QueryTerm<Qs>::Component>()...
+	};
+
+	uint64_t include = 0;
+	uint64_t exclude = 0;
+	if (!getArchetypeMasks<Qs...>(ids, include, exclude))
+	{
+		return;
+	}
+
+	// Archetype chunks are the work items, they're already packed and cache line aligned
+	struct WorkItem
+	{
+		const Archetype* archetype;
+		uint32_t chunk;
+		uint32_t count;
+	};
+
+	std::vector<WorkItem> items;
+	m_archetypes->forEachChunk(include, exclude, [&](const Archetype& archetype, uint32_t chunk, uint32_t count)
+	{
+		items.push_back({&archetype, chunk, count});
+	});
+
+	m_threadPool->parallelFor(static_cast<uint32_t>(items.size()), [&](uint32_t item)
+	{
+		const auto& archetype = *items[item].archetype;
+		const auto entities   = archetype.getEntities(items[item].chunk);
+		const auto columns    = getArchetypeColumns<Qs...>(archetype, items[item].chunk, ids,
+		                                                   std::index_sequence<Is...>());
+
+		for (uint32_t row = 0; row < items[item].count; ++row)
+		{
+			std::apply(func, std::tuple_cat(std::make_tuple(item, entities[row]),
+			                                QueryTerm<Qs>::getArgs(
+				                                std::get<Is>(columns) ? std::get<Is>(columns) + row : nullptr)...));
+		}
+	});
+}
+
+template <typename... Qs, typename Views, size_t... Is>
+bool EntityComponentSystem::passesChangeFilters(const Views& views, uint32_t idx, uint32_t slot,
+                                                const std::array<bool, sizeof...(Qs)>& by_slot, uint32_t since,
+                                                std::index_sequence<Is...>)
+{
+	const auto changed = [&](bool term_by_slot, const auto& view)
+	{
+		return term_by_slot ? view.slotChangedAfter(slot, since) : view.changedAfter(idx, since);
+	};
+	const auto added = [&](bool term_by_slot, const auto& view)
+	{
+		return term_by_slot ? view.slotAddedAfter(slot, since) : view.addedAfter(idx, since);
+	};
+
+	return ((!QueryTerm<Qs>::CHANGED || changed(by_slot[Is], std::get<Is>(views))) && ...)
+		&& ((!QueryTerm<Qs>::ADDED || added(by_slot[Is], std::get<Is>(views))) && ...);
+}
+
+template <typename... Qs, typename Views, size_t... Is>
+void EntityComponentSystem::markQueryWrites(const Views& views, uint32_t idx, uint32_t slot,
+                                            const std::array<bool, sizeof...(Qs)>& by_slot, uint32_t tick,
+                                            std::index_sequence<Is...>)
+{
+	// Optional components are only marked if the entity has them
+	const auto mark = [&](bool writes, bool required, bool term_by_slot, const auto& view)
+	{
+		if (!writes)
+		{
+			return;
+		}
+
+		if (term_by_slot)
+		{
+			view.markSlotChanged(slot, tick);
+		}
+		else if (required || view.has(idx))
+		{
+			view.markChanged(idx, tick);
+		}
+	};
+	(mark(QueryTerm<Qs>::WRITES && QueryTerm<Qs>::HAS_ARG, QueryTerm<Qs>::REQUIRED, by_slot[Is],
+	      std::get<Is>(views)), ...);
+}
+
+template <typename... Qs, typename Views, size_t... Is>
+auto EntityComponentSystem::getQueryArgs(const Views& views, uint32_t idx, uint32_t slot,
+                                         const std::array<bool, sizeof...(Qs)>& by_slot, std::index_sequence<Is...>)
+{
+	return std::tuple_cat(QueryTerm<Qs>::getArgs(by_slot[Is]
+		                                             ? &std::get<Is>(views).slot(slot)
+		                                             : std::get<Is>(views).get(idx))...);
+}
+
+template <typename... Qs, typename Views, size_t... Is>
+bool EntityComponentSystem::findPoolDriver(const Views& views, uint64_t include, PoolDriver<sizeof...(Qs)>& driver,
+                                           std::index_sequence<Is...>) const
+{
+	auto found          = false;
+	const auto consider = [&](bool required, const auto& view)
+	{
+		if (required && view.isPacked() && (!found || view.size() < driver.entities.size()))
+		{
+			driver.entities = Span<const uint32_t>(view.entities(), view.size());
+			found           = true;
+		}
+	};
+	(consider(QueryTerm<Qs>::REQUIRED, std::get<Is>(views)), ...);
+
+	// Terms of the driving component can be read by slot
+	driver.bySlot = {(QueryTerm<Qs>::REQUIRED && found && std::get<Is>(views).isPacked()
+		&& std::get<Is>(views).entities() == driver.entities.data())...};
+
+	// A group is as small as the smallest owned pool, and every owned component can be read by slot
+	const auto group = findGroup(include);
+	if (group && (!found || group->size <= driver.entities.size()))
+	{
+		const uint32_t* entities = nullptr;
+		const auto own = [&](bool& term_by_slot, bool required, uint32_t bit, const auto& view)
+		{
+			term_by_slot = required && bit != ArchetypeStorage::NO_COMPONENT && (group->owned >> bit & 1);
+			if (term_by_slot)
+			{
+				entities = view.entities();
+			}
+		};
+		(own(driver.bySlot[Is], QueryTerm<Qs>::REQUIRED, findComponentBit<typename QueryTerm<Qs>::Component>(),
+		     std::get<Is>(views)), ...);
+
+		driver.entities = Span<const uint32_t>(entities, group->size);
+		found           = true;
+	}
+	return found;
+}
+
+template <typename... Qs, size_t... Is>
+auto EntityComponentSystem::getArchetypeColumns(const Archetype& archetype, uint32_t chunk,
+                                                const std::array<uint32_t, sizeof...(Qs)>& ids,
+                                                std::index_sequence<Is...>)
+{
+	return std::make_tuple(
+		QueryTerm<Qs>::HAS_ARG && ids[Is] != ArchetypeStorage::NO_COMPONENT && archetype.hasComponent(ids[Is])
+			? reinterpret_cast<typename QueryTerm<Qs>::Component*>(archetype.getColumn(chunk, ids[Is]))
+			: nullptr...);
+}
+
+template <typename T>
+void EntityComponentSystem::checkAccess(bool write) const
+{
+#ifndef NDEBUG
+	const auto system = SystemScheduler::getCurrentSystem();
+	if (!system)
+	{
+		return;
+	}
+
+	const auto& access = system->getAccess();
+	if (write ? !access.canWrite(ComponentId::get<T>()) : !access.canRead(ComponentId::get<T>()))
+	{
+		LOG_FATAL << typeid(*system).name() << (write ? " writes " : " reads ") << typeid(T).name()
+			<< " without declaring it";
+	}
+#else
+	(void)write;
+#endif
+}
+
+template <typename... Qs>
+void EntityComponentSystem::checkQueryAccess() const
+{
+	(checkAccess<typename QueryTerm<Qs>::Component>(QueryTerm<Qs>::WRITES), ...);
+}
+
+template <typename... Qs>
+bool EntityComponentSystem::getPoolMasks(uint64_t& care, uint64_t& include) const
+{
+	uint64_t exclude = 0;
+	if (!getArchetypeMasks<Qs...>({findComponentBit<typename QueryTerm<Qs>::Component>()...}, include, exclude))
+	{
+		return false;
+	}
+
+	care = include | exclude;
+	return true;
+}
+
+template <typename... Qs>
+bool EntityComponentSystem::getPoolBitsets(std::array<const EntityBitset*, sizeof...(Qs) + 1>& include,
+                                           uint32_t& num_include,
+                                           std::array<const EntityBitset*, sizeof...(Qs)>& exclude,
+                                           uint32_t& num_exclude) const
+{
+	constexpr std::array<bool, sizeof...(Qs)> required = {QueryTerm<Qs>::REQUIRED...};
+	constexpr std::array<bool, sizeof...(Qs)> excluded = {QueryTerm<Qs>::EXCLUDED...};
+	const std::array<uint32_t, sizeof...(Qs)> bits     = {findComponentBit<typename QueryTerm<Qs>::Component>()...};
+
+	num_include = 0;
+	num_exclude = 0;
+	for (size_t i = 0; i < bits.size(); ++i)
+	{
+		// Nothing can have a component that isn't registered
+		if (bits[i] == ArchetypeStorage::NO_COMPONENT)
+		{
+			if (required[i])
+			{
+				return false;
+			}
+			continue;
+		}
+
+		if (required[i])
+		{
+			include[num_include++] = &m_componentEntities[bits[i]];
+		}
+		else if (excluded[i])
+		{
+			exclude[num_exclude++] = &m_componentEntities[bits[i]];
+		}
+	}
+
+	// Entities with a component are always alive
+	if (num_include == 0)
+	{
+		include[num_include++] = &m_alive;
+	}
+	return true;
+}
+
+template <typename... Qs>
+bool EntityComponentSystem::getArchetypeMasks(const std::array<uint32_t, sizeof...(Qs)>& ids, uint64_t& include,
+                                              uint64_t& exclude)
+{
+	constexpr std::array<bool, sizeof...(Qs)> required = {QueryTerm<Qs>::REQUIRED...};
+	constexpr std::array<bool, sizeof...(Qs)> excluded = {QueryTerm<Qs>::EXCLUDED...};
+
+	for (size_t i = 0; i < ids.size(); ++i)
+	{
+		// Nothing can have a component that isn't registered
+		if (ids[i] == ArchetypeStorage::NO_COMPONENT)
+		{
+			if (required[i])
+			{
+				return false;
+			}
+			continue;
+		}
+
+		if (required[i])
+		{
+			include |= 1ull << ids[i];
+		}
+		else if (excluded[i])
+		{
+			exclude |= 1ull << ids[i];
+		}
+	}
+	return true;
 }
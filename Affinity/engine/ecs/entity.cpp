@@ -17,7 +17,16 @@ uint32_t Entity::getVersion() const
 
 bool Entity::isValid() const
 {
-	return m_ecs && m_idx < m_ecs->m_numEntities && m_ecs->m_versions[m_idx] == m_version;
+	return m_ecs && m_idx < m_ecs->m_numEntities && m_ecs->m_slots[m_idx].version == m_version;
+}
+
+EntityHandle Entity::getHandle() const
+{
+	if (!m_ecs)
+	{
+		return EntityHandle();
+	}
+	return EntityHandle(m_idx, m_version);
 }
 
 void Entity::destroy()
@@ -31,14 +40,31 @@ std::string Entity::getTag() const
 	{
 		return "";
 	}
-	return m_ecs->m_tags[m_idx];
+	return m_ecs->m_tagNames[m_ecs->m_entityTags[m_idx].tag];
+}
+
+uint32_t Entity::getTagId() const
+{
+	if (!isValid())
+	{
+		return EntityComponentSystem::NO_TAG;
+	}
+	return m_ecs->m_entityTags[m_idx].tag;
 }
 
 void Entity::setTag(const std::string& tag)
 {
 	if (isValid())
 	{
-		m_ecs->m_tags[m_idx] = tag;
+		m_ecs->setTag(m_idx, m_ecs->internTag(tag));
+	}
+}
+
+void Entity::setTag(uint32_t tag)
+{
+	if (isValid())
+	{
+		m_ecs->setTag(m_idx, tag);
 	}
 }
 
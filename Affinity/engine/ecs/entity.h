@@ -6,6 +6,26 @@
 #include <cstdint>
 #include <string>
 
+/**
+ * \brief Checks done when components are accessed through entity handles, picked at compile time.
+ * Checked access warns about components that aren't registered, unchecked access only returns nullptr
+ */
+struct CheckedAccess final
+{
+	static constexpr bool WARN_UNREGISTERED = true;
+};
+
+struct UncheckedAccess final
+{
+	static constexpr bool WARN_UNREGISTERED = false;
+};
+
+#ifdef NDEBUG
+using DefaultAccessChecks = UncheckedAccess;
+#else
+using DefaultAccessChecks = CheckedAccess;
+#endif
+
 /**
  * \brief A helper class that makes it easy to work with individual entities
  */
@@ -20,14 +40,22 @@ public:
 
 	bool isValid() const;
 
+	/**
+	 * \brief Get the packed handle of the entity for storing in components
+	 * \return The handle, null handle if the entity is default constructed
+	 */
+	EntityHandle getHandle() const;
+
 	void destroy();
 
 	/**
-	 * \brief Get a component from the entity
+	 * \brief Get a component from the entity. The component is marked as changed unless T is const,
+	 * so use getComponent<const T> to only read it. To access the same component repeatedly, see ComponentRef
 	 * \tparam T Component type
+	 * \tparam Checks CheckedAccess or UncheckedAccess
 	 * \return Pointer to component if available and entity is valid, otherwise nullptr
 	 */
-	template <typename T>
+	template <typename T, typename Checks = DefaultAccessChecks>
 	T* getComponent();
 
 	/**
@@ -47,8 +75,29 @@ public:
 
 	std::string getTag() const;
 
+	/**
+	 * \brief Get the interned id of the entity's tag
+	 * \return Tag id, EntityComponentSystem::NO_TAG if the entity is invalid
+	 */
+	uint32_t getTagId() const;
+
 	void setTag(const std::string& tag);
 
+	/**
+	 * \brief Set the entity's tag to an interned tag, see EntityComponentSystem::internTag
+	 */
+	void setTag(uint32_t tag);
+
+	bool operator==(const Entity& other) const
+	{
+		return m_idx == other.m_idx && m_version == other.m_version && m_ecs == other.m_ecs;
+	}
+
+	bool operator!=(const Entity& other) const
+	{
+		return !(*this == other);
+	}
+
 	friend std::ostream& operator<<(std::ostream& os, const Entity& obj)
 	{
 		return os
@@ -59,6 +108,10 @@ public:
 	}
 private:
 	friend class EntityComponentSystem;
+	friend class EntityRemap;
+
+	template <typename T, typename Checks>
+	friend class ComponentRef;
 
 	Entity(EntityComponentSystem* ecs, uint32_t idx, uint32_t version);
 
@@ -67,20 +120,23 @@ private:
 	EntityComponentSystem* m_ecs = nullptr;
 };
 
-template <typename T>
+template <typename T, typename Checks>
 T* Entity::getComponent()
 {
 	static_assert(std::is_base_of<Component, T>::value, "T must have based class of type Component");
 
-	if (!m_ecs->isComponentRegistered<T>())
+	if (isValid())
 	{
-		LOG_WARNING << typeid(T).name() << " is not a registered component";
-		return nullptr;
+		if (const auto component = m_ecs->findComponent<T>(m_idx))
+		{
+			return component;
+		}
 	}
 
-	if (isValid())
+	// Only check why there's no component on the slow path
+	if (Checks::WARN_UNREGISTERED && m_ecs && !m_ecs->isComponentRegistered<std::remove_const_t<T>>())
 	{
-		return static_cast<T*>(m_ecs->m_components.at(typeid(T)).at(m_idx).get());
+		LOG_WARNING << typeid(T).name() << " is not a registered component";
 	}
 
 	return nullptr;
@@ -92,19 +148,9 @@ void Entity::setComponent(T component)
 	static_assert(std::is_base_of<Component, T>::value, "T must have based class of type Component");
 	if (!isValid()) return;
 
-	if (!m_ecs->isComponentRegistered<T>())
+	if (!m_ecs->setComponent<T>(m_idx, component) && DefaultAccessChecks::WARN_UNREGISTERED)
 	{
 		LOG_WARNING << typeid(T).name() << " is not a registered component";
-		return;
-	}
-
-	if (const auto& c = m_ecs->m_components.at(typeid(T)).at(m_idx))
-	{
-		static_cast<T&>(*c) = component;
-	}
-	else
-	{
-		m_ecs->m_components.at(typeid(T)).at(m_idx) = std::make_unique<T>(component);
 	}
 }
 
@@ -114,11 +160,8 @@ void Entity::removeComponent()
 	static_assert(std::is_base_of<Component, T>::value, "T must have based class of type Component");
 	if (!isValid()) return;
 
-	if (!m_ecs->isComponentRegistered<T>())
+	if (!m_ecs->removeComponent<T>(m_idx) && DefaultAccessChecks::WARN_UNREGISTERED)
 	{
 		LOG_WARNING << typeid(T).name() << " is not a registered component";
-		return;
 	}
-
-	m_ecs->m_components.at(typeid(T)).at(m_idx) = nullptr;
 }
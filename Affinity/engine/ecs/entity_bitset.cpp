@@ -0,0 +1,47 @@
+#include "entity_bitset.h"
+
+#include <algorithm>
+
+void EntityBitset::resize(uint32_t size)
+{
+	// Bits past the old size are always clear, so growing doesn't have to clear anything
+	if (size < m_size && (size & 63))
+	{
+		m_leaves[size >> 6] &= ~0ull >> (64 - (size & 63));
+	}
+
+	m_size = size;
+	m_leaves.resize((size + 63) / 64, 0);
+	m_summary.resize((m_leaves.size() + 63) / 64, 0);
+
+	// Update the last summary word in case leaves were removed or emptied
+	if (!m_summary.empty())
+	{
+		const auto s = static_cast<uint32_t>(m_summary.size() - 1);
+		m_summary[s] = 0;
+		for (auto leaf = s * 64; leaf < m_leaves.size(); ++leaf)
+		{
+			if (m_leaves[leaf])
+			{
+				m_summary[s] |= 1ull << (leaf & 63);
+			}
+		}
+	}
+}
+
+void EntityBitset::clear()
+{
+	std::fill(m_leaves.begin(), m_leaves.end(), 0);
+	std::fill(m_summary.begin(), m_summary.end(), 0);
+}
+
+void EntityBitset::shrinkToFit()
+{
+	m_leaves.shrink_to_fit();
+	m_summary.shrink_to_fit();
+}
+
+uint32_t EntityBitset::size() const
+{
+	return m_size;
+}
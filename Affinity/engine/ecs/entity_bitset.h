@@ -0,0 +1,173 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+/**
+ * \brief Set of entity indices kept as two levels of bits. Every leaf word holds 64 entities and every
+ * summary word has a bit per leaf that isn't empty, so iterating jumps between set bits and costs
+ * about one step per entity in the set plus one per 4096 indices
+ */
+class EntityBitset final
+{
+public:
+	/**
+	 * \brief Resize the set, indices that are added aren't in the set
+	 */
+	void resize(uint32_t size);
+
+	/**
+	 * \brief Remove every index, the size stays the same
+	 */
+	void clear();
+
+	void shrinkToFit();
+
+	void set(uint32_t idx);
+	void reset(uint32_t idx);
+	bool test(uint32_t idx) const;
+
+	uint32_t size() const;
+
+	/**
+	 * \brief Call a function for every index in the set, in increasing order
+	 * \param func Function taking the index
+	 */
+	template <typename Func>
+	void forEach(Func&& func) const;
+
+	/**
+	 * \brief Call a function for every index in [begin, end) that is in every included set and in none
+	 * of the excluded sets, in increasing order. Bits are read again after every call, so the function
+	 * may remove indices from the sets. Every set must hold at least end indices
+	 * \param include Sets an index has to be in, at least one
+	 * \param exclude Sets an index must not be in
+	 * \param func Function taking the index
+	 */
+	template <typename Func>
+	static void forEachMatch(const EntityBitset* const* include, uint32_t num_include,
+	                         const EntityBitset* const* exclude, uint32_t num_exclude,
+	                         uint32_t begin, uint32_t end, Func&& func);
+
+	/**
+	 * \brief Get the index of the lowest set bit, word must not be 0
+	 */
+	static uint32_t countTrailingZeros(uint64_t word);
+private:
+	std::vector<uint64_t> m_leaves;
+	std::vector<uint64_t> m_summary;
+	uint32_t m_size = 0;
+};
+
+inline void EntityBitset::set(uint32_t idx)
+{
+	m_leaves[idx >> 6] |= 1ull << (idx & 63);
+	m_summary[idx >> 12] |= 1ull << ((idx >> 6) & 63);
+}
+
+inline void EntityBitset::reset(uint32_t idx)
+{
+	auto& leaf = m_leaves[idx >> 6];
+	leaf &= ~(1ull << (idx & 63));
+	if (!leaf)
+	{
+		m_summary[idx >> 12] &= ~(1ull << ((idx >> 6) & 63));
+	}
+}
+
+inline bool EntityBitset::test(uint32_t idx) const
+{
+	return m_leaves[idx >> 6] >> (idx & 63) & 1;
+}
+
+inline uint32_t EntityBitset::countTrailingZeros(uint64_t word)
+{
+#ifdef _MSC_VER
+	unsigned long bit;
+	_BitScanForward64(&bit, word);
+	return bit;
+#else
+	return static_cast<uint32_t>(__builtin_ctzll(word));
+#endif
+}
+
+template <typename Func>
+void EntityBitset::forEach(Func&& func) const
+{
+	const EntityBitset* self = this;
+	forEachMatch(&self, 1, nullptr, 0, 0, m_size, func);
+}
+
+template <typename Func>
+void EntityBitset::forEachMatch(const EntityBitset* const* include, uint32_t num_include,
+                                const EntityBitset* const* exclude, uint32_t num_exclude,
+                                uint32_t begin, uint32_t end, Func&& func)
+{
+	if (begin >= end)
+	{
+		return;
+	}
+
+	const auto firstLeaf = begin >> 6;
+	const auto lastLeaf  = (end - 1) >> 6;
+
+	const auto getLeaf = [&](uint32_t leaf)
+	{
+		auto word = ~0ull;
+		for (uint32_t i = 0; i < num_include; ++i)
+		{
+			word &= include[i]->m_leaves[leaf];
+		}
+		for (uint32_t i = 0; i < num_exclude; ++i)
+		{
+			word &= ~exclude[i]->m_leaves[leaf];
+		}
+
+		// Only the indices in [begin, end)
+		if (leaf == firstLeaf)
+		{
+			word &= ~0ull << (begin & 63);
+		}
+		if (leaf == lastLeaf)
+		{
+			word &= ~0ull >> (63 - ((end - 1) & 63));
+		}
+		return word;
+	};
+
+	for (auto s = begin >> 12; s <= lastLeaf >> 6; ++s)
+	{
+		// A leaf can only match if it isn't empty in any of the included sets
+		auto summary = ~0ull;
+		for (uint32_t i = 0; i < num_include; ++i)
+		{
+			summary &= include[i]->m_summary[s];
+		}
+		if (s == firstLeaf >> 6)
+		{
+			summary &= ~0ull << (firstLeaf & 63);
+		}
+		if (s == lastLeaf >> 6)
+		{
+			summary &= ~0ull >> (63 - (lastLeaf & 63));
+		}
+
+		while (summary)
+		{
+			const auto leaf = s * 64 + countTrailingZeros(summary);
+			summary &= summary - 1;
+
+			for (auto word = getLeaf(leaf); word;)
+			{
+				const auto bit = countTrailingZeros(word);
+				func(leaf * 64 + bit);
+
+				// Only bits after the current one, read again in case func removed any
+				word = getLeaf(leaf) & ~0ull << bit << 1;
+			}
+		}
+	}
+}
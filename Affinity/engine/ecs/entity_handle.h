@@ -0,0 +1,60 @@
+#pragma once
+#include <cstdint>
+#include <type_traits>
+
+/**
+ * \brief Packed handle of an entity for storing in components: the index and version in 8 bytes without
+ * a pointer to the ECS, so components holding one stay trivially copyable. Get a usable Entity back with
+ * EntityComponentSystem::getEntity, which returns an invalid entity once the handle's entity is destroyed
+ */
+class EntityHandle final
+{
+public:
+	static constexpr uint32_t NULL_IDX = 0xFFFFFFFF;
+
+	// Default null handle
+	EntityHandle() = default;
+
+	uint32_t getIdx() const
+	{
+		return m_idx;
+	}
+
+	uint32_t getVersion() const
+	{
+		return m_version;
+	}
+
+	/**
+	 * \brief Whether the handle never pointed at an entity. A handle that isn't null can still be stale,
+	 * see EntityComponentSystem::isValid
+	 */
+	bool isNull() const
+	{
+		return m_idx == NULL_IDX;
+	}
+
+	bool operator==(const EntityHandle& other) const
+	{
+		return m_idx == other.m_idx && m_version == other.m_version;
+	}
+
+	bool operator!=(const EntityHandle& other) const
+	{
+		return !(*this == other);
+	}
+private:
+	friend class Entity;
+	friend class EntityRemap;
+
+	EntityHandle(uint32_t idx, uint32_t version)
+		: m_idx(idx), m_version(version)
+	{
+	}
+
+	uint32_t m_idx     = NULL_IDX;
+	uint32_t m_version = 0;
+};
+
+static_assert(sizeof(EntityHandle) == 8, "EntityHandle must stay packed");
+static_assert(std::is_trivially_copyable<EntityHandle>::value, "EntityHandle must be trivially copyable");
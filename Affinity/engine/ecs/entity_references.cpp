@@ -0,0 +1,82 @@
+#include "entity_references.h"
+
+void EntityReferences::set(uint32_t referrer, EntityHandle target)
+{
+	if (target.isNull())
+	{
+		remove(referrer);
+		return;
+	}
+
+	if (referrer >= m_links.size())
+	{
+		m_links.resize(referrer + 1, {EntityHandle(), NONE, NONE});
+	}
+	if (target.getIdx() >= m_heads.size())
+	{
+		m_heads.resize(target.getIdx() + 1, NONE);
+	}
+
+	auto& link = m_links[referrer];
+	if (link.target == target)
+	{
+		return;
+	}
+	if (!link.target.isNull())
+	{
+		unlink(referrer);
+	}
+
+	link.target = target;
+	link.prev   = NONE;
+	link.next   = m_heads[target.getIdx()];
+	if (link.next != NONE)
+	{
+		m_links[link.next].prev = referrer;
+	}
+	m_heads[target.getIdx()] = referrer;
+}
+
+void EntityReferences::remove(uint32_t referrer)
+{
+	if (referrer >= m_links.size() || m_links[referrer].target.isNull())
+	{
+		return;
+	}
+
+	unlink(referrer);
+	m_links[referrer].target = EntityHandle();
+}
+
+void EntityReferences::clear()
+{
+	m_links.clear();
+	m_heads.clear();
+}
+
+EntityHandle EntityReferences::get(uint32_t referrer) const
+{
+	return referrer < m_links.size() ? m_links[referrer].target : EntityHandle();
+}
+
+bool EntityReferences::hasReferrers(uint32_t target_idx) const
+{
+	return target_idx < m_heads.size() && m_heads[target_idx] != NONE;
+}
+
+void EntityReferences::unlink(uint32_t referrer)
+{
+	const auto& link = m_links[referrer];
+	if (link.prev != NONE)
+	{
+		m_links[link.prev].next = link.next;
+	}
+	else
+	{
+		m_heads[link.target.getIdx()] = link.next;
+	}
+	if (link.next != NONE)
+	{
+		m_links[link.next].prev = link.prev;
+	}
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include "entity_handle.h"
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * \brief Reverse index of entity handles: every referenced entity has a list of the entities referencing it,
+ * threaded through flat arrays indexed by entity, so changing a reference is O(1) and finding the referrers
+ * of an entity only visits them. Used by EntityComponentSystem::onReferenceDestroyed
+ */
+class EntityReferences final
+{
+public:
+	static constexpr uint32_t NONE = 0xFFFFFFFF;
+
+	/**
+	 * \brief Set the entity an entity references, replacing its previous reference
+	 * \param referrer Index of the referencing entity
+	 * \param target Referenced entity, a null handle removes the reference
+	 */
+	void set(uint32_t referrer, EntityHandle target);
+
+	void remove(uint32_t referrer);
+
+	void clear();
+
+	/**
+	 * \brief Get the entity an entity references, a null handle if it references nothing
+	 */
+	EntityHandle get(uint32_t referrer) const;
+
+	/**
+	 * \brief Whether any entity references an index, see forEachReferrer
+	 */
+	bool hasReferrers(uint32_t target_idx) const;
+
+	/**
+	 * \brief Call a function for every entity referencing an index. Handles to an entity that was destroyed
+	 * and handles to the entity now at the index are both referencing it, compare the handle to tell them apart
+	 * \param func Function taking the index of the referrer and the handle it references
+	 */
+	template <typename Func>
+	void forEachReferrer(uint32_t target_idx, Func&& func) const;
+private:
+	struct Link final
+	{
+		EntityHandle target; // Null if the entity references nothing
+		uint32_t next;
+		uint32_t prev;
+	};
+
+	void unlink(uint32_t referrer);
+
+	// Indexed by referrer
+	std::vector<Link> m_links;
+
+	// First referrer of every referenced index
+	std::vector<uint32_t> m_heads;
+};
+
+template <typename Func>
+void EntityReferences::forEachReferrer(uint32_t target_idx, Func&& func) const
+{
+	if (target_idx >= m_heads.size())
+	{
+		return;
+	}
+
+	for (auto referrer = m_heads[target_idx]; referrer != NONE;)
+	{
+		// The function may change the reference it's passed
+		const auto& link = m_links[referrer];
+		const auto next  = link.next;
+		func(referrer, link.target);
+		referrer = next;
+	}
+}
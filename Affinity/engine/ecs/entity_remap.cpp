@@ -0,0 +1,44 @@
+#include "entity_remap.h"
+#include "entity.h"
+
+uint32_t EntityRemap::getIdx(uint32_t old_idx) const
+{
+	return old_idx < m_moves.size() ? m_moves[old_idx].idx : DESTROYED;
+}
+
+Entity EntityRemap::apply(Entity entity) const
+{
+	if (!entity.m_ecs || entity.m_idx >= m_moves.size())
+	{
+		return Entity();
+	}
+
+	const auto& move = m_moves[entity.m_idx];
+	if (move.idx == DESTROYED || move.oldVersion != entity.m_version)
+	{
+		return Entity();
+	}
+
+	return Entity(entity.m_ecs, move.idx, move.version);
+}
+
+EntityHandle EntityRemap::apply(EntityHandle handle) const
+{
+	if (handle.m_idx >= m_moves.size())
+	{
+		return EntityHandle();
+	}
+
+	const auto& move = m_moves[handle.m_idx];
+	if (move.idx == DESTROYED || move.oldVersion != handle.m_version)
+	{
+		return EntityHandle();
+	}
+
+	return EntityHandle(move.idx, move.version);
+}
+
+uint32_t EntityRemap::getNumEntities() const
+{
+	return m_numEntities;
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+class Entity;
+class EntityHandle;
+
+/**
+ * \brief Where EntityComponentSystem::compact moved every entity. Components that store entity handles
+ * get their handles remapped during compaction by defining
+ * void remapEntities(const EntityRemap& remap);
+ */
+class EntityRemap final
+{
+public:
+	static constexpr uint32_t DESTROYED = 0xFFFFFFFF;
+
+	/**
+	 * \brief Get the new index of an entity
+	 * \param old_idx Index before compaction
+	 * \return New index, DESTROYED if the index didn't hold an entity
+	 */
+	uint32_t getIdx(uint32_t old_idx) const;
+
+	/**
+	 * \brief Get the handle of an entity after compaction
+	 * \param entity Handle from before compaction
+	 * \return The new handle, invalid entity if the handle was already invalid
+	 */
+	Entity apply(Entity entity) const;
+
+	/**
+	 * \brief Get the packed handle of an entity after compaction
+	 * \param handle Handle from before compaction
+	 * \return The new handle, null handle if the handle was null or already stale
+	 */
+	EntityHandle apply(EntityHandle handle) const;
+
+	/**
+	 * \brief Get the amount of entities after compaction
+	 */
+	uint32_t getNumEntities() const;
+private:
+	friend class EntityComponentSystem;
+
+	struct Move final
+	{
+		uint32_t oldVersion;
+		uint32_t idx;
+		uint32_t version;
+	};
+
+	// Indexed by old index
+	std::vector<Move> m_moves;
+	uint32_t m_numEntities = 0;
+};
+
+/**
+ * \brief Whether or not a component stores entity handles that have to be remapped by compaction
+ */
+template <typename T, typename = void>
+struct HasEntityHandles : std::false_type
+{
+};
+
+template <typename T>
+struct HasEntityHandles<T, std::void_t<decltype(std::declval<T&>().remapEntities(std::declval<const EntityRemap&>()))>>
+	: std::true_type
+{
+};
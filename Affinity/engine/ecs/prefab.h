@@ -0,0 +1,79 @@
+#pragma once
+#include "entity.h"
+
+#include <plog/Log.h>
+
+#include <cstdint>
+#include <memory>
+#include <typeinfo>
+#include <vector>
+
+/**
+ * \brief Components and a tag to create entities with, see EntityComponentSystem::createEntities.
+ * Every entity created from the prefab gets a copy of each component
+ */
+class Prefab final
+{
+public:
+	/**
+	 * \brief Set a component of the prefab, overwrites the old value if already set
+	 * \tparam T Component type
+	 * \param component Value every entity gets
+	 * \return The prefab, for chaining
+	 */
+	template <typename T>
+	Prefab& setComponent(T component = T());
+
+	/**
+	 * \brief Set the tag of the prefab's entities, see EntityComponentSystem::internTag
+	 * \return The prefab, for chaining
+	 */
+	Prefab& setTag(uint32_t tag)
+	{
+		m_tag = tag;
+		return *this;
+	}
+private:
+	friend class EntityComponentSystem;
+
+	struct PrefabComponent final
+	{
+		uint32_t typeId;
+		std::shared_ptr<const void> component;
+
+		// Adds the component to entities that were just created, see EntityComponentSystem::addPrefabComponent
+		void (*add)(EntityComponentSystem& ecs, Span<const uint32_t> indices, const void* component);
+	};
+
+	std::vector<PrefabComponent> m_components;
+	uint32_t m_tag = EntityComponentSystem::DEFAULT_TAG;
+};
+
+template <typename T>
+Prefab& Prefab::setComponent(T component)
+{
+	static_assert(std::is_base_of<Component, T>::value, "T must have based class of type Component");
+
+	const PrefabComponent prefabComponent = {
+		ComponentId::get<T>(),
+		std::make_shared<const T>(std::move(component)),
+		[](EntityComponentSystem& ecs, Span<const uint32_t> indices, const void* c)
+		{
+			if (!ecs.addPrefabComponent<T>(indices, *static_cast<const T*>(c)) && DefaultAccessChecks::WARN_UNREGISTERED)
+			{
+				LOG_WARNING << typeid(T).name() << " is not a registered component";
+			}
+		}
+	};
+
+	for (auto& c : m_components)
+	{
+		if (c.typeId == prefabComponent.typeId)
+		{
+			c = prefabComponent;
+			return *this;
+		}
+	}
+	m_components.push_back(prefabComponent);
+	return *this;
+}
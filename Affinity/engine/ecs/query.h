@@ -0,0 +1,160 @@
+#pragma once
+#include "../util/span.h"
+
+#include <cstdint>
+#include <tuple>
+#include <type_traits>
+
+/*
+ * Filters for EntityComponentSystem::each, for example
+ * ecs.each<Transform, const Boat, Optional<BoatAi>, Without<Cannonball>>(
+ *     [&](uint32_t i, Transform& t, const Boat& b, BoatAi* ai) { ... });
+ *
+ * - T           Entity must have T, passed as T& (const T& for read-only access)
+ * - With<T>     Entity must have T, not passed
+ * - Without<T>  Entity must not have T, not passed
+ * - Optional<T> Entity may have T, passed as T* which is nullptr if it doesn't
+ * - Changed<T>  Entity must have T and T must have been changed since the system last ran, not passed
+ * - Added<T>    Entity must have T and T must have been added since the system last ran, not passed
+ *
+ * A component changes when it's set or passed mutably, i.e. as T& in a query or through
+ * Entity::getComponent<T> with non-const T. Outside of systems "since the system last ran" means since
+ * the last EntityComponentSystem::update started. The archetype storage doesn't track changes,
+ * Changed<T> and Added<T> act like With<T> there
+ */
+template <typename T>
+struct With final
+{
+};
+
+template <typename T>
+struct Without final
+{
+};
+
+template <typename T>
+struct Optional final
+{
+};
+
+template <typename T>
+struct Changed final
+{
+};
+
+template <typename T>
+struct Added final
+{
+};
+
+/**
+ * \brief Describes how a query term filters entities and what it passes to the query function
+ * \tparam Q Component type or filter
+ */
+template <typename Q>
+struct QueryTerm final
+{
+	using Component = std::remove_const_t<Q>;
+
+	static constexpr bool REQUIRED = true;
+	static constexpr bool EXCLUDED = false;
+	static constexpr bool HAS_ARG  = true;
+	static constexpr bool WRITES   = !std::is_const<Q>::value;
+	static constexpr bool CHANGED  = false;
+	static constexpr bool ADDED    = false;
+
+	static std::tuple<Q&> getArgs(Component* component)
+	{
+		return std::tuple<Q&>(*component);
+	}
+
+	static std::tuple<Span<Q>> getSpanArgs(Component* column, uint32_t count)
+	{
+		return std::make_tuple(Span<Q>(column, count));
+	}
+};
+
+template <typename T>
+struct QueryTerm<With<T>> final
+{
+	using Component = std::remove_const_t<T>;
+
+	static constexpr bool REQUIRED = true;
+	static constexpr bool EXCLUDED = false;
+	static constexpr bool HAS_ARG  = false;
+	static constexpr bool WRITES   = false;
+	static constexpr bool CHANGED  = false;
+	static constexpr bool ADDED    = false;
+
+	static std::tuple<> getArgs(Component*) { return {}; }
+	static std::tuple<> getSpanArgs(Component*, uint32_t) { return {}; }
+};
+
+template <typename T>
+struct QueryTerm<Without<T>> final
+{
+	using Component = std::remove_const_t<T>;
+
+	static constexpr bool REQUIRED = false;
+	static constexpr bool EXCLUDED = true;
+	static constexpr bool HAS_ARG  = false;
+	static constexpr bool WRITES   = false;
+	static constexpr bool CHANGED  = false;
+	static constexpr bool ADDED    = false;
+
+	static std::tuple<> getArgs(Component*) { return {}; }
+	static std::tuple<> getSpanArgs(Component*, uint32_t) { return {}; }
+};
+
+template <typename T>
+struct QueryTerm<Optional<T>> final
+{
+	using Component = std::remove_const_t<T>;
+
+	static constexpr bool REQUIRED = false;
+	static constexpr bool EXCLUDED = false;
+	static constexpr bool HAS_ARG  = true;
+	static constexpr bool WRITES   = !std::is_const<T>::value;
+	static constexpr bool CHANGED  = false;
+	static constexpr bool ADDED    = false;
+
+	static std::tuple<T*> getArgs(Component* component)
+	{
+		return std::tuple<T*>(component);
+	}
+
+	// Optional components can't be represented as spans
+	static std::tuple<> getSpanArgs(Component*, uint32_t) = delete;
+};
+
+template <typename T>
+struct QueryTerm<Changed<T>> final
+{
+	using Component = std::remove_const_t<T>;
+
+	static constexpr bool REQUIRED = true;
+	static constexpr bool EXCLUDED = false;
+	static constexpr bool HAS_ARG  = false;
+	static constexpr bool WRITES   = false;
+	static constexpr bool CHANGED  = true;
+	static constexpr bool ADDED    = false;
+
+	static std::tuple<> getArgs(Component*) { return {}; }
+	static std::tuple<> getSpanArgs(Component*, uint32_t) { return {}; }
+};
+
+template <typename T>
+struct QueryTerm<Added<T>> final
+{
+	using Component = std::remove_const_t<T>;
+
+	static constexpr bool REQUIRED = true;
+	static constexpr bool EXCLUDED = false;
+	static constexpr bool HAS_ARG  = false;
+	static constexpr bool WRITES   = false;
+	static constexpr bool CHANGED  = false;
+	static constexpr bool ADDED    = true;
+
+	static std::tuple<> getArgs(Component*) { return {}; }
+	static std::tuple<> getSpanArgs(Component*, uint32_t) { return {}; }
+};
@@ -0,0 +1,146 @@
+#include "spatial_index.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace
+{
+	constexpr uint32_t MIN_BUCKETS      = 1024;
+	constexpr uint32_t MIN_BUCKET_SHIFT = 22;
+}
+
+SpatialIndex::SpatialIndex(float cell_size)
+	: m_cellSize(cell_size), m_invCellSize(1.0f / cell_size)
+{
+	clear();
+}
+
+void SpatialIndex::insert(uint32_t idx, glm::vec2 position, float radius)
+{
+	if (idx >= m_entries.size())
+	{
+		m_entries.resize(idx + 1, {glm::vec2(0), 0.0f, NONE});
+	}
+
+	// Nothing is written for entities that didn't move, so a sync that changes nothing doesn't race with
+	// queries running on other threads
+	auto& entry = m_entries[idx];
+	if (entry.bucket != NONE && entry.position == position && entry.radius == radius)
+	{
+		return;
+	}
+
+	if (entry.bucket == NONE)
+	{
+		// The bucket is set by the next build
+		entry.bucket = 0;
+		++m_size;
+	}
+	entry.position = position;
+	entry.radius   = radius;
+	m_dirty        = true;
+}
+
+void SpatialIndex::remove(uint32_t idx)
+{
+	if (!contains(idx))
+	{
+		return;
+	}
+
+	m_entries[idx].bucket = NONE;
+	--m_size;
+	m_dirty = true;
+}
+
+void SpatialIndex::clear()
+{
+	// The entries are kept so filling the index again doesn't grow the array again
+	for (auto& entry : m_entries)
+	{
+		entry.bucket = NONE;
+	}
+	m_items.clear();
+	m_bucketStarts.assign(MIN_BUCKETS + 1, 0);
+	m_bucketShift = MIN_BUCKET_SHIFT;
+	m_size      = 0;
+	m_dirty     = false;
+	m_maxRadius = 0.0f;
+	m_minCell   = glm::ivec2(std::numeric_limits<int>::max());
+	m_maxCell   = glm::ivec2(std::numeric_limits<int>::min());
+}
+
+void SpatialIndex::build()
+{
+	if (!m_dirty)
+	{
+		return;
+	}
+	m_dirty = false;
+
+	// Keep about one entity per bucket so buckets stay short
+	auto numBuckets = static_cast<uint32_t>(m_bucketStarts.size()) - 1;
+	while (m_size > numBuckets)
+	{
+		numBuckets *= 2;
+		--m_bucketShift;
+	}
+	m_bucketStarts.assign(numBuckets + 1, 0);
+
+	// First pass counts the entities of every bucket
+	m_maxRadius = 0.0f;
+	m_minCell   = glm::ivec2(std::numeric_limits<int>::max());
+	m_maxCell   = glm::ivec2(std::numeric_limits<int>::min());
+	for (auto& entry : m_entries)
+	{
+		if (entry.bucket != NONE)
+		{
+			const auto cell = getCell(entry.position);
+			entry.bucket    = getBucket(cell);
+			++m_bucketStarts[entry.bucket];
+
+			m_maxRadius = std::max(m_maxRadius, entry.radius);
+			m_minCell   = glm::min(m_minCell, cell);
+			m_maxCell   = glm::max(m_maxCell, cell);
+		}
+	}
+
+	// Turn the counts into the end of every bucket
+	for (uint32_t bucket = 1; bucket < numBuckets; ++bucket)
+	{
+		m_bucketStarts[bucket] += m_bucketStarts[bucket - 1];
+	}
+	m_bucketStarts[numBuckets] = m_size;
+
+	// Second pass fills every bucket from its end, walking backwards keeps the entities of a bucket in order
+	// and leaves every bucket's start behind
+	m_items.resize(m_size);
+	for (auto idx = static_cast<uint32_t>(m_entries.size()); idx-- > 0;)
+	{
+		const auto& entry = m_entries[idx];
+		if (entry.bucket != NONE)
+		{
+			m_items[--m_bucketStarts[entry.bucket]] = {entry.position, entry.radius, idx, getCell(entry.position)};
+		}
+	}
+}
+
+bool SpatialIndex::contains(uint32_t idx) const
+{
+	return idx < m_entries.size() && m_entries[idx].bucket != NONE;
+}
+
+glm::vec2 SpatialIndex::getPosition(uint32_t idx) const
+{
+	return m_entries[idx].position;
+}
+
+uint32_t SpatialIndex::size() const
+{
+	return m_size;
+}
+
+float SpatialIndex::getCellSize() const
+{
+	return m_cellSize;
+}
@@ -0,0 +1,374 @@
+#pragma once
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+/**
+ * \brief Uniform grid over the positions of entities for AABB, radius and nearest neighbour queries.
+ * Cells are hashed into a power of two amount of buckets so the grid has no bounds. Inserting, moving and
+ * removing entities is O(1) and only recorded, build bins every entity with a counting sort into one array
+ * where each bucket's entities are contiguous, so queries read memory in order and nothing is allocated
+ * once the arrays have grown. Every entity is a circle around its bounds, queries find the entities whose
+ * circle overlaps the query shape.
+ *
+ * The ECS keeps an index of every entity with a Transform, see EntityComponentSystem::getSpatialIndex
+ */
+class SpatialIndex final
+{
+public:
+	static constexpr float DEFAULT_CELL_SIZE = 256.0f;
+	static constexpr uint32_t NONE           = 0xFFFFFFFF;
+
+	// Default filter of the queries
+	struct AcceptAll final
+	{
+		bool operator()(uint32_t) const
+		{
+			return true;
+		}
+	};
+
+	/**
+	 * \param cell_size Width and height of a cell, about the size of the largest entities works best
+	 */
+	explicit SpatialIndex(float cell_size = DEFAULT_CELL_SIZE);
+
+	/**
+	 * \brief Add an entity, or move it if it's already in the index. Queries see it after the next build
+	 * \param idx Entity index
+	 * \param position Center of the entity
+	 * \param radius Radius of a circle around the entity's bounds
+	 */
+	void insert(uint32_t idx, glm::vec2 position, float radius);
+
+	/**
+	 * \brief Remove an entity, queries stop seeing it after the next build
+	 */
+	void remove(uint32_t idx);
+
+	void clear();
+
+	/**
+	 * \brief Bin the entities inserted, moved and removed since the last build, does nothing if there were none
+	 */
+	void build();
+
+	bool contains(uint32_t idx) const;
+
+	/**
+	 * \brief Get the position an entity was last inserted at, the entity must be in the index
+	 */
+	glm::vec2 getPosition(uint32_t idx) const;
+
+	uint32_t size() const;
+
+	float getCellSize() const;
+
+	/**
+	 * \brief Call a function for every entity overlapping an axis aligned box
+	 * \param min Lower corner of the box
+	 * \param max Upper corner of the box
+	 * \param func Function taking the entity index
+	 * \param filter Function taking the entity index and returning whether to pass it to func
+	 */
+	template <typename Func, typename Filter = AcceptAll>
+	void queryAabb(glm::vec2 min, glm::vec2 max, Func&& func, Filter&& filter = Filter()) const;
+
+	/**
+	 * \brief Call a function for every entity overlapping a circle, see queryAabb
+	 */
+	template <typename Func, typename Filter = AcceptAll>
+	void queryRadius(glm::vec2 center, float radius, Func&& func, Filter&& filter = Filter()) const;
+
+	/**
+	 * \brief Find the entity whose position is closest to a point by searching rings of cells around it
+	 * \param center Point
+	 * \param max_distance Entities further away are ignored, can be infinity
+	 * \param filter Function taking the entity index and returning whether the entity may be picked
+	 * \return Entity index, NONE if no entity passing the filter is close enough
+	 */
+	template <typename Filter = AcceptAll>
+	uint32_t findNearest(glm::vec2 center, float max_distance, Filter&& filter = Filter()) const;
+
+	// Entity found by findKNearest
+	struct Neighbour final
+	{
+		float distanceSquared;
+		uint32_t idx;
+	};
+
+	/**
+	 * \brief Find the k entities whose positions are closest to a point, see findNearest
+	 * \param k Most entities to find
+	 * \param nearest Filled with the entities sorted from nearest to farthest, its memory is reused
+	 */
+	template <typename Filter = AcceptAll>
+	void findKNearest(glm::vec2 center, uint32_t k, float max_distance, std::vector<Neighbour>& nearest,
+		Filter&& filter = Filter()) const;
+private:
+	struct Entry final
+	{
+		glm::vec2 position;
+		float radius;
+		uint32_t bucket; // NONE if the entity isn't in the index, only up to date after a build
+	};
+
+	// An entity as binned by the last build
+	struct Item final
+	{
+		glm::vec2 position;
+		float radius;
+		uint32_t idx;
+		glm::ivec2 cell;
+	};
+
+	// Both run for every cell and entity a query visits, so they're defined here to be inlined
+	glm::ivec2 getCell(glm::vec2 position) const
+	{
+		return glm::ivec2(glm::floor(position * m_invCellSize));
+	}
+
+	uint32_t getBucket(glm::ivec2 cell) const
+	{
+		// Neighbouring cells differ in the low bits only, the multiply spreads them over the high bits which
+		// pick the bucket
+		const auto hash = (static_cast<uint32_t>(cell.x) * 73856093u ^ static_cast<uint32_t>(cell.y) * 19349663u) *
+			2654435761u;
+		return hash >> m_bucketShift;
+	}
+
+	/**
+	 * \brief Call a function for every entity in a range of cells, cells outside of the cells that held an
+	 * entity at the last build are skipped
+	 * \param func Function taking the item
+	 */
+	template <typename Func>
+	void forEachInCells(glm::ivec2 min_cell, glm::ivec2 max_cell, Func&& func) const;
+
+	template <typename Func>
+	void forEachInCell(glm::ivec2 cell, Func& func) const;
+
+	/**
+	 * \brief Call a function for every entity in rings of cells around a point, nearest ring first
+	 * \param func Function taking the item
+	 * \param done Function taking the squared distance every entity in the next ring is at least at, returning
+	 * whether to stop
+	 */
+	template <typename Func, typename Done>
+	void forEachInRings(glm::vec2 center, float max_distance, Func& func, Done&& done) const;
+
+	float m_cellSize;
+	float m_invCellSize;
+
+	// Indexed by entity
+	std::vector<Entry> m_entries;
+	uint32_t m_size = 0;
+	bool m_dirty    = false;
+
+	// Entities sorted by bucket, bucket n holds the items from m_bucketStarts[n] up to m_bucketStarts[n + 1]
+	std::vector<Item> m_items;
+	std::vector<uint32_t> m_bucketStarts;
+	uint32_t m_bucketShift = 0; // 32 - log2 of the amount of buckets
+
+	// Largest radius and the bounds of the cells at the last build, queries widen their cells by the largest
+	// radius so entities overlapping from a neighbouring cell are found
+	float m_maxRadius = 0.0f;
+	glm::ivec2 m_minCell;
+	glm::ivec2 m_maxCell;
+};
+
+template <typename Func, typename Filter>
+void SpatialIndex::queryAabb(glm::vec2 min, glm::vec2 max, Func&& func, Filter&& filter) const
+{
+	forEachInCells(getCell(min - m_maxRadius), getCell(max + m_maxRadius), [&](const Item& item)
+	{
+		// Distance from the circle's center to the closest point of the box
+		const auto offset = item.position - glm::clamp(item.position, min, max);
+		if (glm::dot(offset, offset) <= item.radius * item.radius && filter(item.idx))
+		{
+			func(item.idx);
+		}
+	});
+}
+
+template <typename Func, typename Filter>
+void SpatialIndex::queryRadius(glm::vec2 center, float radius, Func&& func, Filter&& filter) const
+{
+	const auto reach = radius + m_maxRadius;
+	forEachInCells(getCell(center - reach), getCell(center + reach), [&](const Item& item)
+	{
+		const auto offset   = item.position - center;
+		const auto distance = radius + item.radius;
+		if (glm::dot(offset, offset) <= distance * distance && filter(item.idx))
+		{
+			func(item.idx);
+		}
+	});
+}
+
+template <typename Filter>
+uint32_t SpatialIndex::findNearest(glm::vec2 center, float max_distance, Filter&& filter) const
+{
+	if (m_items.empty())
+	{
+		return NONE;
+	}
+
+	auto nearest     = NONE;
+	auto nearestDist = max_distance * max_distance;
+	const auto visit = [&](const Item& item)
+	{
+		const auto offset = item.position - center;
+		const auto dist   = glm::dot(offset, offset);
+		if (dist <= nearestDist && (nearest == NONE || dist < nearestDist) && filter(item.idx))
+		{
+			nearest     = item.idx;
+			nearestDist = dist;
+		}
+	};
+
+	forEachInRings(center, max_distance, visit, [&](float ring_dist)
+	{
+		return nearest != NONE && nearestDist <= ring_dist;
+	});
+	return nearest;
+}
+
+template <typename Filter>
+void SpatialIndex::findKNearest(glm::vec2 center, uint32_t k, float max_distance, std::vector<Neighbour>& nearest,
+                                Filter&& filter) const
+{
+	nearest.clear();
+	if (m_items.empty() || k == 0)
+	{
+		return;
+	}
+
+	// Max heap on the distance, so the farthest of the k nearest so far is the one to replace
+	const auto farther = [](const Neighbour& lhs, const Neighbour& rhs)
+	{
+		return lhs.distanceSquared < rhs.distanceSquared;
+	};
+	const auto maxDist = max_distance * max_distance;
+	const auto visit   = [&](const Item& item)
+	{
+		const auto offset = item.position - center;
+		const auto dist   = glm::dot(offset, offset);
+		if (dist > maxDist || (nearest.size() == k && dist >= nearest.front().distanceSquared) || !filter(item.idx))
+		{
+			return;
+		}
+
+		if (nearest.size() == k)
+		{
+			std::pop_heap(nearest.begin(), nearest.end(), farther);
+			nearest.pop_back();
+		}
+		nearest.push_back({dist, item.idx});
+		std::push_heap(nearest.begin(), nearest.end(), farther);
+	};
+
+	forEachInRings(center, max_distance, visit, [&](float ring_dist)
+	{
+		return nearest.size() == k && nearest.front().distanceSquared <= ring_dist;
+	});
+	std::sort_heap(nearest.begin(), nearest.end(), farther);
+}
+
+template <typename Func>
+void SpatialIndex::forEachInCells(glm::ivec2 min_cell, glm::ivec2 max_cell, Func&& func) const
+{
+	min_cell = glm::max(min_cell, m_minCell);
+	max_cell = glm::min(max_cell, m_maxCell);
+	if (m_items.empty() || min_cell.x > max_cell.x || min_cell.y > max_cell.y)
+	{
+		return;
+	}
+
+	// A range covering more cells than there are buckets is cheaper to find by walking every item once
+	const auto numCells = static_cast<uint64_t>(max_cell.x - min_cell.x + 1) * (max_cell.y - min_cell.y + 1);
+	if (numCells >= m_bucketStarts.size() - 1)
+	{
+		for (const auto& item : m_items)
+		{
+			if (item.cell.x >= min_cell.x && item.cell.y >= min_cell.y && item.cell.x <= max_cell.x &&
+			    item.cell.y <= max_cell.y)
+			{
+				func(item);
+			}
+		}
+		return;
+	}
+
+	for (auto y = min_cell.y; y <= max_cell.y; ++y)
+	{
+		for (auto x = min_cell.x; x <= max_cell.x; ++x)
+		{
+			forEachInCell({x, y}, func);
+		}
+	}
+}
+
+template <typename Func>
+void SpatialIndex::forEachInCell(glm::ivec2 cell, Func& func) const
+{
+	if (cell.x < m_minCell.x || cell.y < m_minCell.y || cell.x > m_maxCell.x || cell.y > m_maxCell.y)
+	{
+		return;
+	}
+
+	// Other cells share the bucket when their hashes collide
+	const auto bucket = getBucket(cell);
+	const auto end    = m_bucketStarts[bucket + 1];
+	for (auto n = m_bucketStarts[bucket]; n < end; ++n)
+	{
+		const auto& item = m_items[n];
+		if (item.cell == cell)
+		{
+			func(item);
+		}
+	}
+}
+
+template <typename Func, typename Done>
+void SpatialIndex::forEachInRings(glm::vec2 center, float max_distance, Func& func, Done&& done) const
+{
+	// Rings past the occupied cells or past max_distance can't hold anything
+	const auto cell    = getCell(center);
+	const auto toEdges = glm::max(cell - m_minCell, m_maxCell - cell);
+	auto lastRing      = glm::max(0, glm::max(toEdges.x, toEdges.y));
+	if (max_distance * m_invCellSize < static_cast<float>(lastRing))
+	{
+		lastRing = static_cast<int>(max_distance * m_invCellSize) + 1;
+	}
+
+	forEachInCell(cell, func);
+	for (auto ring = 1; ring <= lastRing; ++ring)
+	{
+		// Every point in ring n is at least n - 1 cells away from the center
+		const auto ringDist = static_cast<float>(ring - 1) * m_cellSize;
+		if (done(ringDist * ringDist))
+		{
+			return;
+		}
+
+		// Only the part of the ring overlapping the occupied cells is walked
+		const auto minX = glm::max(cell.x - ring, m_minCell.x);
+		const auto maxX = glm::min(cell.x + ring, m_maxCell.x);
+		for (auto x = minX; x <= maxX; ++x)
+		{
+			forEachInCell({x, cell.y - ring}, func);
+			forEachInCell({x, cell.y + ring}, func);
+		}
+
+		const auto minY = glm::max(cell.y - ring + 1, m_minCell.y);
+		const auto maxY = glm::min(cell.y + ring - 1, m_maxCell.y);
+		for (auto y = minY; y <= maxY; ++y)
+		{
+			forEachInCell({cell.x - ring, y}, func);
+			forEachInCell({cell.x + ring, y}, func);
+		}
+	}
+}
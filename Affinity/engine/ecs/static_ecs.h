@@ -0,0 +1,312 @@
+#pragma once
+#include "component.h"
+#include "system.h"
+
+#include <cstdint>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * \brief Handle of an entity in a StaticEntityComponentSystem
+ */
+struct StaticEntity final
+{
+	static constexpr uint32_t INVALID_IDX = 0xFFFFFFFF;
+
+	uint32_t idx     = INVALID_IDX;
+	uint32_t version = 0;
+};
+
+/**
+ * \brief ECS whose components are fixed at compile time. Components are kept in a tuple of dense pools
+ * and every entity has a bitmask of its components, so finding a pool is resolved at compile time and
+ * checking for components is a mask test. No RTTI, hashing or virtual calls are involved in component
+ * access, and using a component that isn't in the list doesn't compile.
+ *
+ * EntityComponentSystem stays the ECS of the engine, components can be registered at runtime there and
+ * systems, queries and tooling work with any component
+ * \tparam Components Every component type the ECS can store, at most 64
+ */
+template <typename... Components>
+class StaticEntityComponentSystem final
+{
+	static_assert(sizeof...(Components) <= 64, "StaticEntityComponentSystem supports at most 64 components");
+	static_assert((std::is_base_of<Component, Components>::value && ...),
+		"Components must have base class of type Component");
+public:
+	template <typename T>
+	static constexpr bool HAS_COMPONENT = (std::is_same<std::remove_const_t<T>, Components>::value || ...);
+
+	/**
+	 * \brief Get the bitmask of a set of components, doesn't compile if any of them aren't in the list
+	 */
+	template <typename... Ts>
+	static constexpr uint64_t getMask();
+
+	/**
+	 * \brief Check at compile time if a system only accesses components in the list
+	 * \tparam SystemType System deriving from SystemWithAccess
+	 */
+	template <typename SystemType>
+	static constexpr bool canRunSystem();
+
+	StaticEntity createEntity();
+	void destroyEntity(StaticEntity entity);
+
+	bool isValid(StaticEntity entity) const;
+
+	/**
+	 * \brief Get a component of an entity
+	 * \return Pointer to the component if the entity is valid and has it, otherwise nullptr
+	 */
+	template <typename T>
+	T* getComponent(StaticEntity entity);
+
+	/**
+	 * \brief Set an entity's component, adding it if the entity doesn't have it yet
+	 */
+	template <typename T>
+	void setComponent(StaticEntity entity, T component = T());
+
+	template <typename T>
+	void removeComponent(StaticEntity entity);
+
+	template <typename... Ts>
+	bool hasComponents(StaticEntity entity) const;
+
+	/**
+	 * \brief Call a function for every entity that has every component
+	 * \tparam Ts Components, const components are passed as const references
+	 * \param func Function taking the entity index followed by a reference to each component
+	 */
+	template <typename... Ts, typename Func>
+	void each(Func&& func);
+
+	/**
+	 * \brief Get the entity at a certain index
+	 * \return The entity, invalid entity if idx is out of bounds or the entity was destroyed
+	 */
+	StaticEntity getEntityByIdx(uint32_t idx) const;
+
+	uint32_t getNumEntities() const;
+	uint32_t getNumActiveEntities() const;
+private:
+	static constexpr uint32_t FREE_LIST_END = 0xFFFFFFFF;
+	static constexpr uint32_t NOT_FREE      = 0xFFFFFFFE;
+
+	struct EntitySlot final
+	{
+		uint32_t version;
+		uint32_t nextFree;
+	};
+
+	template <typename T>
+	static constexpr uint32_t getComponentIndex();
+
+	template <typename... Rs, typename... Ws>
+	static constexpr bool canRunAccess(const SystemWithAccess<Reads<Rs...>, Writes<Ws...>>*);
+
+	template <typename T>
+	std::vector<std::remove_const_t<T>>& getPool();
+
+	/**
+	 * \brief Release resources held by a non-trivial component (i.e. Script) if the entity has it
+	 */
+	template <typename T>
+	static void resetComponent(std::vector<T>& pool, uint32_t idx, uint64_t signature);
+
+	std::tuple<std::vector<Components>...> m_pools;
+
+	// Bitmask of every entity's components, see getMask
+	std::vector<uint64_t> m_signatures;
+	std::vector<EntitySlot> m_slots;
+
+	uint32_t m_freeHead   = FREE_LIST_END;
+	uint32_t m_numFreeIds = 0;
+};
+
+template <typename... Components>
+template <typename... Ts>
+constexpr uint64_t StaticEntityComponentSystem<Components...>::getMask()
+{
+	static_assert((HAS_COMPONENT<Ts> && ...), "Component is not part of this StaticEntityComponentSystem");
+
+	return (0ull | ... | (1ull << getComponentIndex<Ts>()));
+}
+
+template <typename... Components>
+template <typename SystemType>
+constexpr bool StaticEntityComponentSystem<Components...>::canRunSystem()
+{
+	return canRunAccess(static_cast<const SystemType*>(nullptr));
+}
+
+template <typename... Components>
+StaticEntity StaticEntityComponentSystem<Components...>::createEntity()
+{
+	// If can reuse an id
+	if (m_freeHead != FREE_LIST_END)
+	{
+		const auto idx = m_freeHead;
+		auto& slot     = m_slots[idx];
+		m_freeHead     = slot.nextFree;
+		slot.nextFree  = NOT_FREE;
+		--m_numFreeIds;
+		return {idx, slot.version};
+	}
+
+	// Otherwise, if no ids are available to be reused
+	const auto idx = static_cast<uint32_t>(m_slots.size());
+	m_slots.push_back({0, NOT_FREE});
+	m_signatures.push_back(0);
+	std::apply([](auto&... pools) { (pools.emplace_back(), ...); }, m_pools);
+	return {idx, 0};
+}
+
+template <typename... Components>
+void StaticEntityComponentSystem<Components...>::destroyEntity(StaticEntity entity)
+{
+	if (!isValid(entity)) return;
+
+	const auto signature = m_signatures[entity.idx];
+	std::apply([&](auto&... pools) { (resetComponent(pools, entity.idx, signature), ...); }, m_pools);
+	m_signatures[entity.idx] = 0;
+
+	auto& slot    = m_slots[entity.idx];
+	++slot.version;
+	slot.nextFree = m_freeHead;
+	m_freeHead    = entity.idx;
+	++m_numFreeIds;
+}
+
+template <typename... Components>
+bool StaticEntityComponentSystem<Components...>::isValid(StaticEntity entity) const
+{
+	return entity.idx < m_slots.size() && m_slots[entity.idx].nextFree == NOT_FREE
+		&& m_slots[entity.idx].version == entity.version;
+}
+
+template <typename... Components>
+template <typename T>
+T* StaticEntityComponentSystem<Components...>::getComponent(StaticEntity entity)
+{
+	if (!isValid(entity) || !(m_signatures[entity.idx] & getMask<T>()))
+	{
+		return nullptr;
+	}
+	return &getPool<T>()[entity.idx];
+}
+
+template <typename... Components>
+template <typename T>
+void StaticEntityComponentSystem<Components...>::setComponent(StaticEntity entity, T component)
+{
+	if (!isValid(entity)) return;
+
+	getPool<T>()[entity.idx] = std::move(component);
+	m_signatures[entity.idx] |= getMask<T>();
+}
+
+template <typename... Components>
+template <typename T>
+void StaticEntityComponentSystem<Components...>::removeComponent(StaticEntity entity)
+{
+	if (!isValid(entity) || !(m_signatures[entity.idx] & getMask<T>())) return;
+
+	m_signatures[entity.idx] &= ~getMask<T>();
+	if (!std::is_trivially_destructible<T>::value)
+	{
+		getPool<T>()[entity.idx] = T();
+	}
+}
+
+template <typename... Components>
+template <typename... Ts>
+bool StaticEntityComponentSystem<Components...>::hasComponents(StaticEntity entity) const
+{
+	constexpr auto mask = getMask<Ts...>();
+	return isValid(entity) && (m_signatures[entity.idx] & mask) == mask;
+}
+
+template <typename... Components>
+template <typename... Ts, typename Func>
+void StaticEntityComponentSystem<Components...>::each(Func&& func)
+{
+	constexpr auto mask = getMask<Ts...>();
+
+	// Destroyed entities have no components, so they never match
+	const auto signatures  = m_signatures.data();
+	const auto numEntities = static_cast<uint32_t>(m_signatures.size());
+	const auto pools       = std::make_tuple(getPool<Ts>().data()...);
+	for (uint32_t i = 0; i < numEntities; ++i)
+	{
+		if ((signatures[i] & mask) == mask)
+		{
+			func(i, static_cast<Ts&>(std::get<std::remove_const_t<Ts>*>(pools)[i])...);
+		}
+	}
+}
+
+template <typename... Components>
+StaticEntity StaticEntityComponentSystem<Components...>::getEntityByIdx(uint32_t idx) const
+{
+	if (idx < m_slots.size() && m_slots[idx].nextFree == NOT_FREE)
+	{
+		return {idx, m_slots[idx].version};
+	}
+	return {};
+}
+
+template <typename... Components>
+uint32_t StaticEntityComponentSystem<Components...>::getNumEntities() const
+{
+	return static_cast<uint32_t>(m_slots.size());
+}
+
+template <typename... Components>
+uint32_t StaticEntityComponentSystem<Components...>::getNumActiveEntities() const
+{
+	return getNumEntities() - m_numFreeIds;
+}
+
+template <typename... Components>
+template <typename T>
+constexpr uint32_t StaticEntityComponentSystem<Components...>::getComponentIndex()
+{
+	constexpr bool matches[] = {std::is_same<std::remove_const_t<T>, Components>::value...};
+	for (uint32_t i = 0; i < sizeof...(Components); ++i)
+	{
+		if (matches[i])
+		{
+			return i;
+		}
+	}
+	return 0;
+}
+
+template <typename... Components>
+template <typename... Rs, typename... Ws>
+constexpr bool StaticEntityComponentSystem<Components...>::canRunAccess(
+	const SystemWithAccess<Reads<Rs...>, Writes<Ws...>>*)
+{
+	return (HAS_COMPONENT<Rs> && ...) && (HAS_COMPONENT<Ws> && ...);
+}
+
+template <typename... Components>
+template <typename T>
+std::vector<std::remove_const_t<T>>& StaticEntityComponentSystem<Components...>::getPool()
+{
+	return std::get<std::vector<std::remove_const_t<T>>>(m_pools);
+}
+
+template <typename... Components>
+template <typename T>
+void StaticEntityComponentSystem<Components...>::resetComponent(std::vector<T>& pool, uint32_t idx, uint64_t signature)
+{
+	if (!std::is_trivially_destructible<T>::value && signature & getMask<T>())
+	{
+		pool[idx] = T();
+	}
+}
@@ -0,0 +1,270 @@
+#include "sweep_batch.h"
+
+#include <algorithm>
+#include <limits>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define SWEEP_BATCH_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace
+{
+	constexpr auto MISS = std::numeric_limits<float>::infinity();
+
+#ifdef SWEEP_BATCH_X86
+	bool hasAvx2()
+	{
+#ifdef _MSC_VER
+		// AVX2 needs the CPU to support it and the OS to save the AVX registers
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7)
+		{
+			return false;
+		}
+		__cpuid(info, 1);
+		const auto osSavesAvx = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 6) == 6;
+		__cpuidex(info, 7, 0);
+		return osSavesAvx && (info[1] & (1 << 5)) != 0;
+#else
+		return __builtin_cpu_supports("avx2");
+#endif
+	}
+
+	// Picks a where the mask is set and b elsewhere, SSE2 has no blend
+	__m128 selectSse(__m128 mask, __m128 a, __m128 b)
+	{
+		return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+	}
+
+	// Narrows the entry and exit of 4 sweeps by one axis of their boxes, a sweep moving parallel to the axis is
+	// either always inside the box's slab or never
+	void clipSse(__m128 start, __m128 end, __m128 box_min, __m128 box_max, __m128& enter, __m128& exit)
+	{
+		const auto move   = _mm_sub_ps(end, start);
+		const auto t0     = _mm_div_ps(_mm_sub_ps(box_min, start), move);
+		const auto t1     = _mm_div_ps(_mm_sub_ps(box_max, start), move);
+		const auto inside = _mm_and_ps(_mm_cmpge_ps(start, box_min), _mm_cmple_ps(start, box_max));
+
+		// Lanes moving parallel enter at -inf and exit at inf when inside, and the other way around otherwise
+		const auto parallel = _mm_cmpeq_ps(move, _mm_setzero_ps());
+		const auto inf      = _mm_set1_ps(MISS);
+		const auto negInf   = _mm_set1_ps(-MISS);
+		const auto low      = selectSse(parallel, selectSse(inside, negInf, inf), _mm_min_ps(t0, t1));
+		const auto high     = selectSse(parallel, selectSse(inside, inf, negInf), _mm_max_ps(t0, t1));
+
+		enter = _mm_max_ps(enter, low);
+		exit  = _mm_min_ps(exit, high);
+	}
+
+	TARGET_AVX2 void clipAvx2(__m256 start, __m256 end, __m256 box_min, __m256 box_max, __m256& enter,
+	                          __m256& exit)
+	{
+		const auto move   = _mm256_sub_ps(end, start);
+		const auto t0     = _mm256_div_ps(_mm256_sub_ps(box_min, start), move);
+		const auto t1     = _mm256_div_ps(_mm256_sub_ps(box_max, start), move);
+		const auto inside = _mm256_and_ps(_mm256_cmp_ps(start, box_min, _CMP_GE_OQ),
+			_mm256_cmp_ps(start, box_max, _CMP_LE_OQ));
+
+		const auto parallel = _mm256_cmp_ps(move, _mm256_setzero_ps(), _CMP_EQ_OQ);
+		const auto inf      = _mm256_set1_ps(MISS);
+		const auto negInf   = _mm256_set1_ps(-MISS);
+		const auto low      = _mm256_blendv_ps(_mm256_min_ps(t0, t1), _mm256_blendv_ps(inf, negInf, inside), parallel);
+		const auto high     = _mm256_blendv_ps(_mm256_max_ps(t0, t1), _mm256_blendv_ps(negInf, inf, inside), parallel);
+
+		enter = _mm256_max_ps(enter, low);
+		exit  = _mm256_min_ps(exit, high);
+	}
+#endif
+}
+
+SweepBatch::KernelEnum SweepBatch::getBestKernel()
+{
+#ifdef SWEEP_BATCH_X86
+	static const auto best = hasAvx2() ? KernelEnum::AVX2 : KernelEnum::SSE;
+	return best;
+#else
+	return KernelEnum::SCALAR;
+#endif
+}
+
+float SweepBatch::sweep(glm::vec2 start, glm::vec2 end, glm::vec2 box_origin, glm::vec2 box_rotation,
+                        glm::vec2 box_min, glm::vec2 box_max)
+{
+	// Convert the segment into the box's coordinates
+	const auto rotate = [&](glm::vec2 p)
+	{
+		p -= box_origin;
+		return glm::vec2(p.x * box_rotation.x - p.y * box_rotation.y, p.x * box_rotation.y + p.y * box_rotation.x);
+	};
+	start = rotate(start);
+	end   = rotate(end);
+
+	auto enter = 0.0f;
+	auto exit  = 1.0f;
+	for (auto axis = 0; axis < 2; ++axis)
+	{
+		const auto move = end[axis] - start[axis];
+		if (move == 0.0f)
+		{
+			// Moving parallel to the slab, either always inside it or never
+			if (start[axis] < box_min[axis] || start[axis] > box_max[axis])
+			{
+				return MISS;
+			}
+			continue;
+		}
+
+		auto t0 = (box_min[axis] - start[axis]) / move;
+		auto t1 = (box_max[axis] - start[axis]) / move;
+		if (t0 > t1)
+		{
+			std::swap(t0, t1);
+		}
+		enter = std::max(enter, t0);
+		exit  = std::min(exit, t1);
+		if (enter > exit)
+		{
+			return MISS;
+		}
+	}
+	return enter;
+}
+
+void SweepBatch::clear()
+{
+	for (auto* column : {&m_startX, &m_startY, &m_endX, &m_endY, &m_originX, &m_originY, &m_cos, &m_sin, &m_minX,
+	                     &m_minY, &m_maxX, &m_maxY, &m_results})
+	{
+		column->clear();
+	}
+}
+
+uint32_t SweepBatch::add(glm::vec2 start, glm::vec2 end, glm::vec2 box_origin, glm::vec2 box_rotation,
+                         glm::vec2 box_min, glm::vec2 box_max)
+{
+	m_startX.push_back(start.x);
+	m_startY.push_back(start.y);
+	m_endX.push_back(end.x);
+	m_endY.push_back(end.y);
+	m_originX.push_back(box_origin.x);
+	m_originY.push_back(box_origin.y);
+	m_cos.push_back(box_rotation.x);
+	m_sin.push_back(box_rotation.y);
+	m_minX.push_back(box_min.x);
+	m_minY.push_back(box_min.y);
+	m_maxX.push_back(box_max.x);
+	m_maxY.push_back(box_max.y);
+	m_results.push_back(MISS);
+	return size() - 1;
+}
+
+void SweepBatch::run(KernelEnum kernel)
+{
+	// The sweeps left over after the last full set of lanes go through the scalar kernel
+	auto done = 0u;
+	switch (kernel)
+	{
+	case KernelEnum::AVX2:
+		done = runAvx2(done);
+		break;
+	case KernelEnum::SSE:
+		done = runSse(done);
+		break;
+	case KernelEnum::SCALAR:
+		break;
+	}
+	runScalar(done);
+}
+
+uint32_t SweepBatch::runScalar(uint32_t first)
+{
+	for (auto i = first; i < size(); ++i)
+	{
+		m_results[i] = sweep(glm::vec2(m_startX[i], m_startY[i]), glm::vec2(m_endX[i], m_endY[i]),
+			glm::vec2(m_originX[i], m_originY[i]), glm::vec2(m_cos[i], m_sin[i]), glm::vec2(m_minX[i], m_minY[i]),
+			glm::vec2(m_maxX[i], m_maxY[i]));
+	}
+	return size();
+}
+
+#ifdef SWEEP_BATCH_X86
+uint32_t SweepBatch::runSse(uint32_t first)
+{
+	auto i = first;
+	for (; i + 4 <= size(); i += 4)
+	{
+		// Convert the segments into the boxes' coordinates
+		const auto c         = _mm_loadu_ps(&m_cos[i]);
+		const auto s         = _mm_loadu_ps(&m_sin[i]);
+		const auto originX   = _mm_loadu_ps(&m_originX[i]);
+		const auto originY   = _mm_loadu_ps(&m_originY[i]);
+		const auto startX    = _mm_sub_ps(_mm_loadu_ps(&m_startX[i]), originX);
+		const auto startY    = _mm_sub_ps(_mm_loadu_ps(&m_startY[i]), originY);
+		const auto endX      = _mm_sub_ps(_mm_loadu_ps(&m_endX[i]), originX);
+		const auto endY      = _mm_sub_ps(_mm_loadu_ps(&m_endY[i]), originY);
+		const auto rotStartX = _mm_sub_ps(_mm_mul_ps(startX, c), _mm_mul_ps(startY, s));
+		const auto rotStartY = _mm_add_ps(_mm_mul_ps(startX, s), _mm_mul_ps(startY, c));
+		const auto rotEndX   = _mm_sub_ps(_mm_mul_ps(endX, c), _mm_mul_ps(endY, s));
+		const auto rotEndY   = _mm_add_ps(_mm_mul_ps(endX, s), _mm_mul_ps(endY, c));
+
+		auto enter = _mm_setzero_ps();
+		auto exit  = _mm_set1_ps(1.0f);
+		clipSse(rotStartX, rotEndX, _mm_loadu_ps(&m_minX[i]), _mm_loadu_ps(&m_maxX[i]), enter, exit);
+		clipSse(rotStartY, rotEndY, _mm_loadu_ps(&m_minY[i]), _mm_loadu_ps(&m_maxY[i]), enter, exit);
+
+		const auto hit = _mm_cmple_ps(enter, exit);
+		_mm_storeu_ps(&m_results[i], selectSse(hit, enter, _mm_set1_ps(MISS)));
+	}
+	return i;
+}
+
+TARGET_AVX2 uint32_t SweepBatch::runAvx2(uint32_t first)
+{
+	auto i = first;
+	for (; i + 8 <= size(); i += 8)
+	{
+		const auto c         = _mm256_loadu_ps(&m_cos[i]);
+		const auto s         = _mm256_loadu_ps(&m_sin[i]);
+		const auto originX   = _mm256_loadu_ps(&m_originX[i]);
+		const auto originY   = _mm256_loadu_ps(&m_originY[i]);
+		const auto startX    = _mm256_sub_ps(_mm256_loadu_ps(&m_startX[i]), originX);
+		const auto startY    = _mm256_sub_ps(_mm256_loadu_ps(&m_startY[i]), originY);
+		const auto endX      = _mm256_sub_ps(_mm256_loadu_ps(&m_endX[i]), originX);
+		const auto endY      = _mm256_sub_ps(_mm256_loadu_ps(&m_endY[i]), originY);
+		const auto rotStartX = _mm256_sub_ps(_mm256_mul_ps(startX, c), _mm256_mul_ps(startY, s));
+		const auto rotStartY = _mm256_add_ps(_mm256_mul_ps(startX, s), _mm256_mul_ps(startY, c));
+		const auto rotEndX   = _mm256_sub_ps(_mm256_mul_ps(endX, c), _mm256_mul_ps(endY, s));
+		const auto rotEndY   = _mm256_add_ps(_mm256_mul_ps(endX, s), _mm256_mul_ps(endY, c));
+
+		auto enter = _mm256_setzero_ps();
+		auto exit  = _mm256_set1_ps(1.0f);
+		clipAvx2(rotStartX, rotEndX, _mm256_loadu_ps(&m_minX[i]), _mm256_loadu_ps(&m_maxX[i]), enter, exit);
+		clipAvx2(rotStartY, rotEndY, _mm256_loadu_ps(&m_minY[i]), _mm256_loadu_ps(&m_maxY[i]), enter, exit);
+
+		const auto hit = _mm256_cmp_ps(enter, exit, _CMP_LE_OQ);
+		_mm256_storeu_ps(&m_results[i], _mm256_blendv_ps(_mm256_set1_ps(MISS), enter, hit));
+	}
+
+	// Avoids the penalty of switching back to SSE code with the upper halves of the registers in use
+	_mm256_zeroupper();
+	return i;
+}
+#else
+uint32_t SweepBatch::runSse(uint32_t first)
+{
+	return first;
+}
+
+uint32_t SweepBatch::runAvx2(uint32_t first)
+{
+	return first;
+}
+#endif
@@ -0,0 +1,89 @@
+#pragma once
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * \brief Points swept along segments through rotated boxes, stored as one array per coordinate so that run
+ * tests 4 sweeps at a time with SSE or 8 with AVX2. The kernel is picked when the program runs, CPUs without
+ * AVX2 and builds for other architectures get the SSE or scalar kernel.
+ *
+ * Every box is given in its own coordinates, around an origin and turned by a rotation that the caller
+ * computes once per box rather than once per sweep
+ */
+class SweepBatch final
+{
+public:
+	enum class KernelEnum
+	{
+		SCALAR,
+		SSE,
+		AVX2
+	};
+
+	/**
+	 * \brief The widest kernel the CPU supports, only checked the first time
+	 */
+	static KernelEnum getBestKernel();
+
+	/**
+	 * \brief Sweep a point through a box on its own, what every kernel computes for each sweep
+	 * \param start Start of the segment
+	 * \param end End of the segment
+	 * \param box_origin Origin of the box's coordinates
+	 * \param box_rotation Cosine and sine of minus the box's rotation
+	 * \param box_min Lower corner of the box in its own coordinates
+	 * \param box_max Upper corner of the box in its own coordinates
+	 * \return How far along the segment the point enters the box, 0 if it starts inside, above 1 if it misses
+	 */
+	static float sweep(glm::vec2 start, glm::vec2 end, glm::vec2 box_origin, glm::vec2 box_rotation,
+	                   glm::vec2 box_min, glm::vec2 box_max);
+
+	void clear();
+
+	/**
+	 * \brief Add a sweep, see sweep for the parameters
+	 * \return Index of the sweep's result
+	 */
+	uint32_t add(glm::vec2 start, glm::vec2 end, glm::vec2 box_origin, glm::vec2 box_rotation, glm::vec2 box_min,
+	             glm::vec2 box_max);
+
+	/**
+	 * \brief Run every sweep added since the last clear
+	 * \param kernel Kernel to run them with, falls back to a narrower one if this build doesn't have it
+	 */
+	void run(KernelEnum kernel = getBestKernel());
+
+	/**
+	 * \brief Result of a sweep after run, see sweep
+	 */
+	float getResult(uint32_t sweep) const
+	{
+		return m_results[sweep];
+	}
+
+	uint32_t size() const
+	{
+		return static_cast<uint32_t>(m_results.size());
+	}
+private:
+	// Each kernel runs the sweeps from first that fill its lanes and returns where it stopped
+	uint32_t runScalar(uint32_t first);
+	uint32_t runSse(uint32_t first);
+	uint32_t runAvx2(uint32_t first);
+
+	std::vector<float> m_startX;
+	std::vector<float> m_startY;
+	std::vector<float> m_endX;
+	std::vector<float> m_endY;
+	std::vector<float> m_originX;
+	std::vector<float> m_originY;
+	std::vector<float> m_cos;
+	std::vector<float> m_sin;
+	std::vector<float> m_minX;
+	std::vector<float> m_minY;
+	std::vector<float> m_maxX;
+	std::vector<float> m_maxY;
+	std::vector<float> m_results;
+};
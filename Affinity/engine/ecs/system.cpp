@@ -0,0 +1,51 @@
+#include "system.h"
+
+#include <algorithm>
+
+bool SystemAccess::canRead(uint32_t component) const
+{
+	return exclusive || canWrite(component) || std::find(reads.begin(), reads.end(), component) != reads.end();
+}
+
+bool SystemAccess::canWrite(uint32_t component) const
+{
+	return exclusive || std::find(writes.begin(), writes.end(), component) != writes.end();
+}
+
+bool SystemAccess::conflictsWith(const SystemAccess& other) const
+{
+	if (exclusive || other.exclusive)
+	{
+		return true;
+	}
+
+	// Reading the same components is fine, anything involving a write isn't
+	for (const auto component : writes)
+	{
+		if (other.canRead(component))
+		{
+			return true;
+		}
+	}
+	for (const auto component : other.writes)
+	{
+		if (canRead(component))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+void System::init(EntityComponentSystem&)
+{
+}
+
+void System::sync(Engine&, EntityComponentSystem&)
+{
+}
+
+uint32_t System::getLastRunTick() const
+{
+	return m_lastRunTick;
+}
@@ -1,4 +1,10 @@
 #pragma once
+#include "component.h"
+
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
 class Engine;
 class EntityComponentSystem;
 
@@ -6,6 +12,57 @@ struct Transform;
 struct Boat;
 struct BoatAi;
 
+/*
+ * Systems declare which components they access so the ECS can run systems that don't
+ * conflict at the same time, for example
+ * class ParticleSystem final : public SystemWithAccess<Reads<>, Writes<Particle, Sprite>>
+ *
+ * - Reads<Ts...>  Components the system only reads
+ * - Writes<Ts...> Components the system reads and writes
+ * - AnyComponent  Written by systems that can access anything or make structural changes in update,
+ *                 they run alone on the main thread
+ *
+ * Other systems must not create or destroy entities or add or remove components in update,
+ * those changes are recorded in a command buffer (EntityComponentSystem::getCommandBuffer) which is
+ * applied once every system has been updated
+ */
+template <typename... Ts>
+struct Reads final
+{
+};
+
+template <typename... Ts>
+struct Writes final
+{
+};
+
+struct AnyComponent final
+{
+};
+
+/**
+ * \brief Components a system accesses
+ */
+struct SystemAccess final
+{
+	/**
+	 * \param component Component id, see ComponentId
+	 */
+	bool canRead(uint32_t component) const;
+	bool canWrite(uint32_t component) const;
+
+	/**
+	 * \brief Check if two systems can't run at the same time
+	 * \param other Access of the other system
+	 * \return Whether or not either system writes something the other one accesses
+	 */
+	bool conflictsWith(const SystemAccess& other) const;
+
+	std::vector<uint32_t> reads;
+	std::vector<uint32_t> writes;
+	bool exclusive = false;
+};
+
 class System
 {
 public:
@@ -16,5 +73,55 @@ public:
 	System& operator=(const System& other) = default;
 	System& operator=(System&& other) noexcept = default;
 
+	/**
+	 * \brief Runs on the main thread once the system is added, before it first updates. Observers are added here
+	 */
+	virtual void init(EntityComponentSystem& ecs);
+
+	/**
+	 * \brief Update the system, may run on any thread at the same time as systems it doesn't conflict with
+	 */
 	virtual void update(Engine& engine, EntityComponentSystem& ecs) = 0;
+
+	/**
+	 * \brief Runs on the main thread in system order after every system has been updated and the
+	 * command buffers have been applied
+	 */
+	virtual void sync(Engine& engine, EntityComponentSystem& ecs);
+
+	virtual const SystemAccess& getAccess() const = 0;
+
+	/**
+	 * \brief Get the change tick the system's previous update started at, Changed and Added filters of
+	 * the system's queries match components changed after it
+	 */
+	uint32_t getLastRunTick() const;
+private:
+	friend class SystemScheduler;
+
+	uint32_t m_lastRunTick = 0;
+	uint32_t m_runTick     = 0;
+};
+
+template <typename ReadList, typename WriteList>
+class SystemWithAccess;
+
+/**
+ * \brief Base class of systems that declares their access at compile time
+ * \tparam Rs Components the system only reads
+ * \tparam Ws Components the system reads and writes
+ */
+template <typename... Rs, typename... Ws>
+class SystemWithAccess<Reads<Rs...>, Writes<Ws...>> : public System
+{
+public:
+	const SystemAccess& getAccess() const final
+	{
+		static const SystemAccess access = {
+			{ComponentId::get<Rs>()...},
+			{ComponentId::get<Ws>()...},
+			(std::is_same<Ws, AnyComponent>::value || ...)
+		};
+		return access;
+	}
 };
@@ -0,0 +1,220 @@
+#include "system_scheduler.h"
+#include "ecs.h"
+
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#include <immintrin.h>
+#endif
+
+namespace
+{
+	thread_local const System* currentSystem = nullptr;
+
+	// Tells the CPU the thread is spinning, so it doesn't take execution resources from the other hyperthread
+	void pause()
+	{
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+		_mm_pause();
+#elif defined(__aarch64__) && !defined(_MSC_VER)
+		asm volatile("yield");
+#endif
+	}
+}
+
+SystemScheduler::SystemScheduler(uint32_t num_threads)
+	: m_maxThreads(std::max(1u, num_threads))
+{
+}
+
+SystemScheduler::~SystemScheduler()
+{
+	stopWorkers();
+}
+
+void SystemScheduler::build(const std::vector<std::unique_ptr<System>>& systems)
+{
+	stopWorkers();
+
+	m_nodes.clear();
+	for (const auto& system : systems)
+	{
+		m_nodes.push_back({system.get(), {}, 0});
+	}
+
+	// A system depends on every earlier system it conflicts with, so conflicting systems keep their order
+	const auto numNodes = static_cast<uint32_t>(m_nodes.size());
+	auto numShared      = 0u;
+	for (uint32_t j = 0; j < numNodes; ++j)
+	{
+		for (uint32_t i = 0; i < j; ++i)
+		{
+			if (m_nodes[i].system->getAccess().conflictsWith(m_nodes[j].system->getAccess()))
+			{
+				m_nodes[i].dependents.push_back(j);
+				++m_nodes[j].numDependencies;
+			}
+		}
+		if (!m_nodes[j].system->getAccess().exclusive)
+		{
+			++numShared;
+		}
+	}
+
+	m_pendingDependencies = std::make_unique<std::atomic<uint32_t>[]>(numNodes);
+
+	// Which systems overlap depends on how long each one takes, any systems that don't share a chain of
+	// conflicts may run at the same time. Only systems with exclusive access are sure to stay on the main thread
+	startWorkers(std::min(std::max(numShared, 1u), m_maxThreads) - 1);
+}
+
+void SystemScheduler::run(Engine& engine, EntityComponentSystem& ecs)
+{
+	if (m_nodes.empty())
+	{
+		return;
+	}
+
+	m_engine = &engine;
+	m_ecs    = &ecs;
+	m_unfinished.store(static_cast<uint32_t>(m_nodes.size()), std::memory_order_relaxed);
+
+	// Every count has to be set before the first system starts and counts down its dependents
+	for (uint32_t i = 0; i < m_nodes.size(); ++i)
+	{
+		m_pendingDependencies[i].store(m_nodes[i].numDependencies, std::memory_order_relaxed);
+	}
+	for (uint32_t i = 0; i < m_nodes.size(); ++i)
+	{
+		if (m_nodes[i].numDependencies == 0)
+		{
+			pushReady(i);
+		}
+	}
+
+	// Help out until every system is done, systems with exclusive access only run here
+	while (m_unfinished.load(std::memory_order_acquire) != 0)
+	{
+		if (!runReadySystem(true))
+		{
+			std::this_thread::yield();
+		}
+	}
+}
+
+const System* SystemScheduler::getCurrentSystem()
+{
+	return currentSystem;
+}
+
+uint32_t SystemScheduler::getNumWorkers() const
+{
+	return static_cast<uint32_t>(m_workers.size());
+}
+
+void SystemScheduler::startWorkers(uint32_t num_workers)
+{
+	for (uint32_t i = 0; i < num_workers; ++i)
+	{
+		m_workers.emplace_back(&SystemScheduler::workerLoop, this);
+	}
+}
+
+void SystemScheduler::stopWorkers()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopping = true;
+	}
+	m_wakeCondition.notify_all();
+
+	for (auto& worker : m_workers)
+	{
+		worker.join();
+	}
+	m_workers.clear();
+	m_stopping = false;
+}
+
+void SystemScheduler::workerLoop()
+{
+	while (true)
+	{
+		// Spin for a moment first, the next system is usually ready within microseconds
+		for (uint32_t i = 0; i < SPIN_ITERATIONS && m_numReady.load(std::memory_order_relaxed) == 0; ++i)
+		{
+			pause();
+		}
+
+		if (runReadySystem(false))
+		{
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_wakeCondition.wait(lock, [&] { return m_stopping || !m_ready.empty(); });
+		if (m_stopping)
+		{
+			return;
+		}
+	}
+}
+
+bool SystemScheduler::runReadySystem(bool main_thread)
+{
+	uint32_t node;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (main_thread && !m_readyMainThread.empty())
+		{
+			node = m_readyMainThread.back();
+			m_readyMainThread.pop_back();
+		}
+		else if (!m_ready.empty())
+		{
+			node = m_ready.back();
+			m_ready.pop_back();
+			m_numReady.fetch_sub(1, std::memory_order_relaxed);
+		}
+		else
+		{
+			return false;
+		}
+	}
+
+	// Every update starts a new change tick, so the system can tell changes made after it started apart
+	auto& system         = *m_nodes[node].system;
+	system.m_lastRunTick = system.m_runTick;
+	system.m_runTick     = m_ecs->advanceChangeTick();
+
+	currentSystem = &system;
+	system.update(*m_engine, *m_ecs);
+	currentSystem = nullptr;
+
+	for (const auto dependent : m_nodes[node].dependents)
+	{
+		if (m_pendingDependencies[dependent].fetch_sub(1, std::memory_order_acq_rel) == 1)
+		{
+			pushReady(dependent);
+		}
+	}
+
+	m_unfinished.fetch_sub(1, std::memory_order_release);
+	return true;
+}
+
+void SystemScheduler::pushReady(uint32_t node)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_nodes[node].system->getAccess().exclusive)
+		{
+			m_readyMainThread.push_back(node);
+			return;
+		}
+
+		m_ready.push_back(node);
+		m_numReady.fetch_add(1, std::memory_order_relaxed);
+	}
+	m_wakeCondition.notify_one();
+}
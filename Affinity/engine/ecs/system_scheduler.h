@@ -0,0 +1,91 @@
+#pragma once
+#include "system.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * \brief Runs the systems of an ECS as a dependency graph. Two systems that conflict run in the order
+ * they were added, systems that don't conflict may run at the same time on the scheduler's workers.
+ * Workers spin for a few microseconds before going to sleep, so systems that become ready right after
+ * another one finishes start without waiting for the OS to wake a thread. They aren't pinned to cores,
+ * the OS places them around the ECS's thread pool
+ */
+class SystemScheduler final
+{
+public:
+	/**
+	 * \param num_threads Most threads used to run systems, including the thread calling run
+	 */
+	explicit SystemScheduler(uint32_t num_threads = std::thread::hardware_concurrency());
+	~SystemScheduler();
+	SystemScheduler(const SystemScheduler& other) = delete;
+	SystemScheduler(SystemScheduler&& other) noexcept = delete;
+	SystemScheduler& operator=(const SystemScheduler& other) = delete;
+	SystemScheduler& operator=(SystemScheduler&& other) noexcept = delete;
+
+	/**
+	 * \brief Build the dependency graph, has to be called again whenever systems are added
+	 * \param systems Systems in the order they were added
+	 */
+	void build(const std::vector<std::unique_ptr<System>>& systems);
+
+	/**
+	 * \brief Update every system and wait for all of them to finish
+	 */
+	void run(Engine& engine, EntityComponentSystem& ecs);
+
+	/**
+	 * \brief Get the system being updated on the current thread
+	 * \return The system, nullptr if the thread isn't updating a system
+	 */
+	static const System* getCurrentSystem();
+
+	uint32_t getNumWorkers() const;
+private:
+	// Pause instructions before a worker sleeps, each takes from a few to about a hundred cycles
+	static constexpr uint32_t SPIN_ITERATIONS = 256;
+
+	struct Node final
+	{
+		System* system;
+		std::vector<uint32_t> dependents;
+		uint32_t numDependencies = 0;
+	};
+
+	void startWorkers(uint32_t num_workers);
+	void stopWorkers();
+	void workerLoop();
+
+	/**
+	 * \brief Update one ready system if there is one
+	 * \param main_thread Whether or not the calling thread is the one that called run
+	 * \return False if there was nothing to do
+	 */
+	bool runReadySystem(bool main_thread);
+
+	void pushReady(uint32_t node);
+
+	uint32_t m_maxThreads;
+	std::vector<Node> m_nodes;
+	std::unique_ptr<std::atomic<uint32_t>[]> m_pendingDependencies;
+
+	Engine* m_engine            = nullptr;
+	EntityComponentSystem* m_ecs = nullptr;
+
+	std::mutex m_mutex;
+	std::condition_variable m_wakeCondition;
+	std::vector<uint32_t> m_ready;
+	std::vector<uint32_t> m_readyMainThread; // Systems with exclusive access
+	bool m_stopping = false;
+
+	alignas(64) std::atomic<uint32_t> m_numReady{0};
+	alignas(64) std::atomic<uint32_t> m_unfinished{0};
+
+	std::vector<std::thread> m_workers;
+};
@@ -1,40 +1,91 @@
 ﻿#include "boat_system.h"
 #include "../components.h"
+#include "../command_buffer.h"
 #include "../../engine.h"
 #include "../../config.h"
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
 void BoatSystem::update(Engine& engine, EntityComponentSystem& ecs)
 {
-	auto& tVec  = ecs.getComponentVector<Transform>();
-	auto& bVec  = ecs.getComponentVector<Boat>();
-	auto& aiVec = ecs.getComponentVector<BoatAi>();
+	const auto delta = static_cast<float>(engine.getFrameTimer().getDelta());
 
-	ecs.entityLoop([&](uint32_t i)
+	// Handle cooldown for cannon firing, every boat is independent so it runs on the thread pool
+	ecs.parallelEach<Boat>([delta](uint32_t, Boat& b)
 	{
-		const auto t  = static_cast<Transform*>(tVec[i].get());
-		const auto b  = static_cast<Boat*>(bVec[i].get());
-		const auto ai = static_cast<BoatAi*>(aiVec[i].get());
+		if (b.cooldownRemaining > 0.0f)
+		{
+			b.cooldownRemaining -= delta;
+			if (b.cooldownRemaining < 0.0f)
+			{
+				b.cooldownRemaining = 0.0f;
+			}
+		}
+	});
 
-		// Boat and transform components are required
-		if (!(b && t))
+	// Targets are searched for among the boats where they were when the update started. Every team has its own
+	// bins so a search only visits enemies, and ends right away once a team has no boats left
+	for (auto& team : m_teams)
+	{
+		team.clear();
+	}
+	ecs.each<const Transform, const Boat>([&](uint32_t i, const Transform& t, const Boat& b)
+	{
+		if (b.team != Boat::BoatTeamEnum::NEUTRAL)
 		{
-			return;
+			m_teams[static_cast<size_t>(b.team)].insert(i, t.position, glm::length(t.scale));
 		}
+	});
+	for (auto& team : m_teams)
+	{
+		team.build();
+	}
 
-		// Handle cooldown for cannon firing
-		if (b->cooldownRemaining > 0.0f)
+	// Boats whose target sank look for a new one, a batch at a time so the losses of a battle don't all
+	// look at once
+	const auto pending      = m_retargets.size() - m_nextRetarget;
+	const auto numRetargets = std::min(pending, std::max(MIN_RETARGETS, pending / RETARGET_UPDATES));
+	for (const auto end = m_nextRetarget + numRetargets; m_nextRetarget < end; ++m_nextRetarget)
+	{
+		const auto handle = m_retargets[m_nextRetarget];
+		m_awaitingRetarget[handle.getIdx()] = false;
+
+		auto boat     = ecs.getEntity(handle);
+		const auto t  = boat.getComponent<const Transform>();
+		const auto b  = boat.getComponent<const Boat>();
+		const auto ai = boat.getComponent<const BoatAi>();
+		if (t && b && ai && !ecs.isValid(ai->target))
 		{
-			b->cooldownRemaining -= static_cast<float>(engine.getFrameTimer().getDelta());
-			if (b->cooldownRemaining < 0.0f)
-			{
-				b->cooldownRemaining = 0.0f;
-			}
+			findTarget(ecs, *b, *t, handle.getIdx());
 		}
+	}
+	if (m_nextRetarget == m_retargets.size())
+	{
+		m_retargets.clear();
+		m_nextRetarget = 0;
+	}
 
-		// If there's an AI component, do ai stuff
-		if (ai)
+	// AI reads other boats' transforms while moving its own, so it stays on this thread
+	ecs.each<Transform, Boat, BoatAi>([&](uint32_t i, Transform& t, Boat& b, BoatAi& ai)
+	{
+		handleAi(engine, ecs, b, t, ai, i);
+	});
+}
+
+void BoatSystem::init(EntityComponentSystem& ecs)
+{
+	ecs.onReferenceDestroyed<BoatAi>(&BoatAi::target, [this](Span<Entity> boats)
+	{
+		for (const auto& boat : boats)
 		{
-			handleAi(engine, ecs, *b, *t, *ai, i);
+			if (boat.getIdx() >= m_awaitingRetarget.size())
+			{
+				m_awaitingRetarget.resize(boat.getIdx() + 1);
+			}
+			m_awaitingRetarget[boat.getIdx()] = true;
+			m_retargets.push_back(boat.getHandle());
 		}
 	});
 }
@@ -99,39 +150,64 @@ void BoatSystem::rotateBoatTowardVec(Engine& engine, float& rotation, glm::vec2
 void BoatSystem::handleAi(Engine& engine, EntityComponentSystem& ecs, Boat& b, Transform& t, BoatAi& ai,
                           uint32_t entity_index)
 {
-	if (ai.target.isValid())
+	if (ecs.isValid(ai.target))
 	{
+		auto& target = getTargetRefs(ecs, ai, entity_index);
+
 		// Target needs to have a transform component
-		if (const auto targetT = ai.target.getComponent<Transform>())
+		if (const auto targetT = target.transform.get())
 		{
-			// Get the distance between the two - todo: replace distance func, unnecessary sqrt
-			const auto distance = glm::distance(targetT->position, t.position);
+			// Get the squared distance between the two
+			const auto offset   = targetT->position - t.position;
+			const auto distance = glm::dot(offset, offset);
 
 			// Depending on distance, choose a behavior. If neutral, always wander
-			if (distance > EFFECTIVE_RANGE * 2 && b.team != Boat::BoatTeamEnum::NEUTRAL)
+			if (distance > EFFECTIVE_RANGE * EFFECTIVE_RANGE * 4 && b.team != Boat::BoatTeamEnum::NEUTRAL)
 			{
 				// Get closer to target
 				ai.behavior = BoatAi::BehaviorEnum::APPROACH;
-				performApproachAi(engine, t, b, ai);
+				performApproachAi(engine, t, b, *targetT);
 			}
 			else
 			{
 				// Align with target and fire when possible
 				ai.behavior = BoatAi::BehaviorEnum::ALIGN;
-				performAlignAi(engine, ecs, t, b, ai, entity_index);
+				performAlignAi(engine, ecs, t, b, target, entity_index);
 			}
 		}
 	}
 	else
 	{
-		// If the current target is an invalid entity, wander and try to find a new target
+		// If the current target is an invalid entity, wander and try to find a new target. Boats whose target
+		// sank wait for their batch above instead
 		ai.behavior = BoatAi::BehaviorEnum::WANDER;
 		performWanderAi(engine, t, b);
-		findTarget(engine, ecs, b, t, ai);
+		if (entity_index >= m_awaitingRetarget.size() || !m_awaitingRetarget[entity_index])
+		{
+			findTarget(ecs, b, t, entity_index);
+		}
 	}
 }
 
-bool BoatSystem::isBoatInOptimalBox(Transform& t, Transform& target_t)
+BoatSystem::TargetRefs& BoatSystem::getTargetRefs(EntityComponentSystem& ecs, const BoatAi& ai,
+                                                  uint32_t entity_index)
+{
+	if (entity_index >= m_targets.size())
+	{
+		m_targets.resize(entity_index + 1);
+	}
+
+	// Boats pick new targets and entity indices get reused, so the handles are rebound when the target differs
+	auto& target = m_targets[entity_index];
+	if (target.transform.getEntity().getHandle() != ai.target)
+	{
+		const auto entity = ecs.getEntity(ai.target);
+		target            = {ComponentRef<const Transform>(entity), ComponentRef<const Boat>(entity)};
+	}
+	return target;
+}
+
+bool BoatSystem::isBoatInOptimalBox(const Transform& t, const Transform& target_t)
 {
 	/*
 	 Optimal box goes out from sides of boat like so
@@ -183,9 +259,9 @@ void BoatSystem::performWanderAi(Engine& engine, Transform& t, Boat& b)
 	moveBoatForward(engine, t, b);
 }
 
-void BoatSystem::performApproachAi(Engine& engine, Transform& t, Boat& b, BoatAi& ai)
+void BoatSystem::performApproachAi(Engine& engine, Transform& t, Boat& b, const Transform& target_t)
 {
-	const auto targetPos = ai.target.getComponent<Transform>()->position;
+	const auto targetPos = target_t.position;
 	const auto targetVec = targetPos - t.position;
 
 	// Rotate the boat to the target vec
@@ -202,11 +278,11 @@ void BoatSystem::performApproachAi(Engine& engine, Transform& t, Boat& b, BoatAi
 }
 
 // This code is a little complicated, hopefully it's not too hard to get a sense of what's happening
-void BoatSystem::performAlignAi(Engine& engine, EntityComponentSystem& ecs, Transform& t, Boat& b, BoatAi& ai,
+void BoatSystem::performAlignAi(Engine& engine, EntityComponentSystem& ecs, Transform& t, Boat& b, TargetRefs& target,
                                 uint32_t entity_index)
 {
-	const auto targetT     = ai.target.getComponent<Transform>();
-	const auto targetSpeed = ai.target.getComponent<Boat>()->speed;
+	const auto targetT     = target.transform.get();
+	const auto targetSpeed = target.boat.get()->speed;
 
 	// Get the vector to be at so that the boat is parallel to target
 	auto tangentVec = getTangentVec(targetT->position, t.position);
@@ -283,15 +359,13 @@ void BoatSystem::performAlignAi(Engine& engine, EntityComponentSystem& ecs, Tran
 				cos(t.rotation + glm::half_pi<float>() * (shouldShootFromRightSide ? 1 : -1)),
 				sin(t.rotation + glm::half_pi<float>() * (shouldShootFromRightSide ? 1 : -1)));
 
-			// Create the cannonball
-			auto ball = ecs.createEntity();
-			ball.setComponent<Transform>(
-				Transform(t.position + ballVec * t.scale.y * 0.5f, atan2(ballVec.y, ballVec.x),
-				          config::CANNONBALL_SIZE));
-			ball.setComponent<Sprite>(
-				Sprite(engine.getRenderer().getSpritesheet().getUv(
-					"cannonball")));
-			ball.setComponent<Cannonball>(Cannonball(ballVec, 30, ecs.getEntityByIdx(entity_index)));
+			// Create the cannonball, it's added to the world once every system has been updated
+			auto& commands = ecs.getCommandBuffer();
+			const auto ball = commands.createEntity();
+			commands.setComponent<Transform>(ball, Transform(t.position + ballVec * t.scale.y * 0.5f,
+				atan2(ballVec.y, ballVec.x), config::CANNONBALL_SIZE));
+			commands.setComponent<Sprite>(ball, Sprite(engine.getRenderer().getSpritesheet().getUv("cannonball")));
+			commands.setComponent<Cannonball>(ball, Cannonball(ballVec, 30, ecs.getEntityByIdx(entity_index).getHandle()));
 		}
 	}
 
@@ -299,38 +373,32 @@ void BoatSystem::performAlignAi(Engine& engine, EntityComponentSystem& ecs, Tran
 	moveBoatForward(engine, t, b);
 }
 
-void BoatSystem::findTarget(Engine& engine, EntityComponentSystem& ecs, Boat& b, Transform& t, BoatAi& ai)
+void BoatSystem::findTarget(EntityComponentSystem& ecs, const Boat& b, const Transform& t, uint32_t entity_index)
 {
-	auto& bVec = ecs.getComponentVector<Boat>();
-	auto& tVec = ecs.getComponentVector<Transform>();
-
-	float dist         = -1;
-	uint32_t targetIdx = 0;
-
-	// todo: spatial partitioning
-	ecs.entityLoop([&](uint32_t i)
+	// Target must be a boat on another team, the search of the next team only has to beat the nearest so far
+	auto nearest            = SpatialIndex::NONE;
+	auto nearestDistSquared = std::numeric_limits<float>::infinity();
+	for (size_t team = 0; team < NUM_TEAMS; ++team)
 	{
-		// Target must be a boat
-		if (const auto boat = static_cast<Boat*>(bVec[i].get()))
+		if (team == static_cast<size_t>(b.team))
 		{
-			// Target must be on opposite team
-			const auto targetT = static_cast<Transform*>(tVec[i].get());
-			if (targetT && boat->team != Boat::BoatTeamEnum::NEUTRAL && boat->team != b.team)
-			{
-				// Check if closer than current closest
-				const auto targetDist = glm::distance(t.position, targetT->position);
-				if (dist == -1 || targetDist < dist)
-				{
-					dist      = targetDist;
-					targetIdx = i;
-				}
-			}
+			continue;
 		}
-	});
+
+		// The search radius is the only place the distance itself is needed
+		const auto& enemies = m_teams[team];
+		const auto enemy    = enemies.findNearest(t.position, std::sqrt(nearestDistSquared));
+		if (enemy != SpatialIndex::NONE)
+		{
+			const auto offset  = enemies.getPosition(enemy) - t.position;
+			nearest            = enemy;
+			nearestDistSquared = glm::dot(offset, offset);
+		}
+	}
 
 	// If a new target was found, set the target
-	if (dist != -1)
+	if (nearest != SpatialIndex::NONE)
 	{
-		ai.target = ecs.getEntityByIdx(targetIdx);
+		ecs.setReference<BoatAi>(entity_index, &BoatAi::target, ecs.getEntityByIdx(nearest).getHandle());
 	}
 }
@@ -1,31 +1,71 @@
 ﻿#pragma once
 #include "../system.h"
+#include "../components.h"
+#include "../component_ref.h"
+#include "../spatial_index.h"
 
 #include <glm/glm.hpp>
+#include <array>
 #include <utility>
+#include <vector>
 
 /**
  * \brief Manages boats and boat AIs
  */
-class BoatSystem final : public System
+class BoatSystem final : public SystemWithAccess<Reads<>, Writes<Transform, Boat, BoatAi>>
 {
 public:
+	void init(EntityComponentSystem& ecs) override;
 	void update(Engine& engine, EntityComponentSystem& ecs) override;
 private:
 	static constexpr float EFFECTIVE_RANGE = 250.0f;
+	static constexpr size_t NUM_TEAMS      = 3; // Amount of Boat::BoatTeamEnum values
+
+	// Boats whose target was destroyed look for a new one over about this many updates, at least
+	// MIN_RETARGETS per update
+	static constexpr size_t RETARGET_UPDATES = 4;
+	static constexpr size_t MIN_RETARGETS    = 32;
+
+	// Components of a boat's target, looked up again only when their pools change
+	struct TargetRefs final
+	{
+		ComponentRef<const Transform> transform;
+		ComponentRef<const Boat> boat;
+	};
+
+	/**
+	 * \brief Get the handles to the components of a boat's target, following the target when it changes
+	 */
+	TargetRefs& getTargetRefs(EntityComponentSystem& ecs, const BoatAi& ai, uint32_t entity_index);
 
 	std::pair<glm::vec2, glm::vec2> findContactsFromTangent(glm::vec2 circle_center, float radius,
 		float tangent_slope) const;
 	glm::vec2 getTangentVec(glm::vec2 circle_center, glm::vec2 point) const;
 	void rotateBoatTowardVec(Engine& engine, float& rotation, glm::vec2 target_vec) const;
-	bool isBoatInOptimalBox(Transform& t, Transform& target_t);
+	bool isBoatInOptimalBox(const Transform& t, const Transform& target_t);
 
 	void moveBoatForward(Engine& engine, Transform& t, Boat& b);
 
-	void handleAi(Engine& engine, EntityComponentSystem& ecs, Boat& b, Transform& t, BoatAi& ai, uint32_t entity_index);
+	void handleAi(Engine& engine, EntityComponentSystem& ecs, Boat& b, Transform& t, BoatAi& ai,
+		uint32_t entity_index);
 
 	void performWanderAi(Engine& engine, Transform& t, Boat& b);
-	void performApproachAi(Engine& engine, Transform& t, Boat& b, BoatAi& ai);
-	void performAlignAi(Engine& engine, EntityComponentSystem& ecs, Transform& t, Boat& b, BoatAi& ai, uint32_t entity_index);
-	void findTarget(Engine& engine, EntityComponentSystem& ecs, Boat& b, Transform& t, BoatAi& ai);
+	void performApproachAi(Engine& engine, Transform& t, Boat& b, const Transform& target_t);
+	void performAlignAi(Engine& engine, EntityComponentSystem& ecs, Transform& t, Boat& b, TargetRefs& target,
+		uint32_t entity_index);
+	void findTarget(EntityComponentSystem& ecs, const Boat& b, const Transform& t, uint32_t entity_index);
+
+	// Indexed by the boat's entity index
+	std::vector<TargetRefs> m_targets;
+
+	// Boats of every team binned again every update, indexed by Boat::BoatTeamEnum. Neutral boats are never
+	// targeted so their bins stay empty
+	std::array<SpatialIndex, NUM_TEAMS> m_teams;
+
+	// Boats whose target was destroyed, from m_nextRetarget on. Filled by an observer of BoatAi::target
+	std::vector<EntityHandle> m_retargets;
+	size_t m_nextRetarget = 0;
+
+	// Indexed by the boat's entity index, set while the boat is in m_retargets so it doesn't search on its own
+	std::vector<bool> m_awaitingRetarget;
 };
@@ -1,29 +1,27 @@
 ﻿#include "particle_system.h"
 #include "../components.h"
+#include "../command_buffer.h"
 #include "../../engine.h"
 
 void ParticleSystem::update(Engine& engine, EntityComponentSystem& ecs)
 {
-	auto& pVec = ecs.getComponentVector<Particle>();
-	auto& sVec = ecs.getComponentVector<Sprite>();
+	const auto delta = static_cast<float>(engine.getFrameTimer().getDelta());
 
-	ecs.entityLoop([&](uint32_t i)
+	// Only visits entities that have a particle, every particle is independent so it runs on the thread pool
+	ecs.parallelEach<Particle, Optional<Sprite>>([&](uint32_t i, Particle& particle, Sprite* sprite)
 	{
-		if (const auto particle = static_cast<Particle*>(pVec[i].get()))
-		{
-			// Lower remaining lifetime
-			particle->lifetime -= static_cast<float>(engine.getFrameTimer().getDelta());
+		// Lower remaining lifetime
+		particle.lifetime -= delta;
 
-			// If particle is too old, destroy it
-			if (particle->lifetime <= 0)
-			{
-				ecs.getEntityByIdx(i).destroy();
-			}
-			// Otherwise, if it has a sprite, lower opacity based on lifetime and fadetime
-			else if (const auto sprite = static_cast<Sprite*>(sVec[i].get()))
-			{
-				sprite->color.a = glm::clamp(particle->lifetime / particle->fadetime, 0.0f, 1.0f);
-			}
+		// If particle is too old, destroy it, each thread records into its own command buffer
+		if (particle.lifetime <= 0)
+		{
+			ecs.getCommandBuffer().destroyEntity(ecs.getEntityByIdx(i));
+		}
+		// Otherwise, if it has a sprite, lower opacity based on lifetime and fadetime
+		else if (sprite)
+		{
+			sprite->color.a = glm::clamp(particle.lifetime / particle.fadetime, 0.0f, 1.0f);
 		}
 	});
 }
@@ -1,7 +1,8 @@
 ﻿#pragma once
 #include "../system.h"
+#include "../components.h"
 
-class ParticleSystem final : public System
+class ParticleSystem final : public SystemWithAccess<Reads<>, Writes<Particle, Sprite>>
 {
 public:
 	void update(Engine& engine, EntityComponentSystem& ecs) override;
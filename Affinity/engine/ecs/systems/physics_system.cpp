@@ -1,124 +1,144 @@
 #include "physics_system.h"
 #include "../components.h"
+#include "../command_buffer.h"
 #include "../../engine.h"
 
+#include <limits>
+
+glm::vec2 PhysicsSystem::getSweepRotation(float rotation)
+{
+	return glm::vec2(cos(-rotation), sin(-rotation));
+}
+
+float PhysicsSystem::sweepCannonball(glm::vec2 start, glm::vec2 end, glm::vec2 ball_scale, const Transform& boat)
+{
+	// The cannonball hits while its box's lower corner is inside the boat's box
+	return SweepBatch::sweep(start, end, boat.position, getSweepRotation(boat.rotation), ball_scale - boat.scale,
+		ball_scale);
+}
+
 // This code could be improved a little more but it's fine
 void PhysicsSystem::update(Engine& engine, EntityComponentSystem& ecs)
 {
-	auto& tVec = ecs.getComponentVector<Transform>();
-	auto& cVec = ecs.getComponentVector<Cannonball>();
-	auto& bVec = ecs.getComponentVector<Boat>();
-
-	// Spatial partition into grid based system, todo: move into ecs so it's accessible by other systems
-	std::unordered_map<glm::ivec2, std::vector<uint32_t>> cannonballGrid;
-	std::unordered_map<glm::ivec2, std::vector<uint32_t>> boatGrid;
+	const auto delta = static_cast<float>(engine.getFrameTimer().getDelta());
 
-	ecs.entityLoop([&](uint32_t i)
+	// Cannonballs are only tested against boats, so the boats get an index of their own rather than sharing
+	// the ECS's index with the cannonballs. The radius covers the boat's box at any rotation. Every boat's
+	// rotation is turned into a cosine and sine once here rather than for every cannonball near it
+	m_boats.clear();
+	ecs.each<const Transform, const Boat, Without<Cannonball>>([&](uint32_t i, const Transform& t, const Boat& b)
 	{
-		// Requires a transform component to be spatially partitioned
-		if (const auto t = static_cast<Transform*>(tVec[i].get()))
+		if (b.health > 0)
 		{
-			// Convert the position into grid coordinates
-			const auto pos = glm::ivec2(floor(t->position / CHUNK_SIZE));
-
-			// If it's a cannonball, put it into the cannonball grid
-			if (static_cast<Cannonball*>(cVec[i].get()))
+			m_boats.insert(i, t.position, glm::length(t.scale));
+			if (i >= m_boatRotations.size())
 			{
-				cannonballGrid[pos].emplace_back(i);
+				m_boatRotations.resize(i + 1);
 			}
-				// Otherwise, if it's a boat, put it into the boat grid
-			else if (static_cast<Boat*>(bVec[i].get()))
+			m_boatRotations[i] = getSweepRotation(t.rotation);
+		}
+	});
+	m_boats.build();
+
+	// Cannonballs are swept along the whole distance they travel in an update, so they can't tunnel through a
+	// boat and hit the same boats however long the update is. Every cannonball and boat pair the broadphase finds
+	// goes into one batch, so the narrowphase tests several pairs at once
+	m_shots.clear();
+	m_candidates.clear();
+	m_sweeps.clear();
+	ecs.each<Transform, Cannonball>([&](uint32_t cannonballIdx, Transform& transform, Cannonball& cannonball)
+	{
+		// Speed drops by 1 every 60th of a second, the distance covered is integrated exactly so it doesn't
+		// depend on the update's length either
+		const auto start    = transform.position;
+		const auto distance = cannonball.speed > delta
+			? (cannonball.speed - delta * 0.5f) * delta
+			: cannonball.speed * cannonball.speed * 0.5f;
+		const auto end = start + cannonball.direction * distance;
+		transform.position = end;
+		cannonball.speed -= delta;
+
+		// The query covers the cannonball's whole path and reaches into the neighbouring cells by the largest
+		// boat's radius so boats across a cell edge are found too
+		const auto firstCandidate = static_cast<uint32_t>(m_candidates.size());
+		m_boats.queryAabb(glm::min(start, end) - transform.scale, glm::max(start, end) + transform.scale,
+			[&](uint32_t bIdx)
 			{
-				boatGrid[pos].emplace_back(i);
-			}
+				// Cannonballs shouldn't hit their mothership
+				if (cannonball.parentShip.getIdx() == bIdx && ecs.isValid(cannonball.parentShip))
+				{
+					return;
+				}
+
+				const auto bTransform = ecs.getEntityByIdx(bIdx).getComponent<const Transform>();
+				m_sweeps.add(start, end, bTransform->position, m_boatRotations[bIdx],
+					transform.scale - bTransform->scale, transform.scale);
+				m_candidates.push_back(bIdx);
+			});
+
+		// Only cannonballs that may hit a boat or fall into the water have anything left to do
+		if (m_candidates.size() > firstCandidate || cannonball.speed <= 0)
+		{
+			m_shots.push_back({cannonballIdx, firstCandidate, start, end, cannonball.speed <= 0});
 		}
 	});
 
-	// Extremely basic AABB collision detection, does not prevent tunneling
-	// todo: maybe better collision detection, alternatively tunneling is a feature and it simulates missing a shot
-	// todo: fix spatial partitioning over chunk edges
-	for (auto& cannonballGridSquare : cannonballGrid)
+	m_sweeps.run();
+
+	auto& commands = ecs.getCommandBuffer();
+	for (size_t shot = 0; shot < m_shots.size(); ++shot)
 	{
-		// Go over each cannonball
-		for (auto& cannonballIdx : cannonballGridSquare.second)
+		const auto& s            = m_shots[shot];
+		const auto lastCandidate = shot + 1 < m_shots.size()
+			? m_shots[shot + 1].firstCandidate
+			: static_cast<uint32_t>(m_candidates.size());
+
+		// Find the boat the cannonball reaches first
+		auto firstHit = std::numeric_limits<float>::infinity();
+		auto hitBoat  = SpatialIndex::NONE;
+		for (auto candidate = s.firstCandidate; candidate < lastCandidate; ++candidate)
 		{
-			auto transform  = static_cast<Transform*>(tVec[cannonballIdx].get());
-			auto cannonball = static_cast<Cannonball*>(cVec[cannonballIdx].get());
-
-			// The transform and cannonball should be guaranteed
-			if (!(transform && cannonball))
+			const auto t = m_sweeps.getResult(candidate);
+			if (t >= firstHit)
 			{
 				continue;
 			}
 
-			// Move the cannonball and update velocity
-			transform->position += cannonball->direction * cannonball->speed
-				* static_cast<float>(engine.getFrameTimer().getDelta());
-			cannonball->speed -= static_cast<float>(engine.getFrameTimer().getDelta());
-
-			// Cannonball should "fall into the water" when speed is 0
-			if (cannonball->speed <= 0)
+			// Boats sunk during this update are only destroyed once the command buffers are applied
+			if (ecs.getEntityByIdx(m_candidates[candidate]).getComponent<const Boat>()->health <= 0)
 			{
-				ecs.getEntityByIdx(cannonballIdx).destroy();
 				continue;
 			}
+			firstHit = t;
+			hitBoat  = m_candidates[candidate];
+		}
 
-			// Check collisions with boats in same grid
-			for (auto& bIdx : boatGrid[cannonballGridSquare.first])
+		if (hitBoat == SpatialIndex::NONE)
+		{
+			// Cannonball should "fall into the water" when speed is 0
+			if (s.fallsIntoWater)
 			{
-				auto bTransform = static_cast<Transform*>(tVec[bIdx].get());
-				auto boat       = static_cast<Boat*>(bVec[bIdx].get());
-
-				// Again, should be guaranteed already
-				if (!(bTransform && boat))
-				{
-					continue;
-				}
-
-				// Get box for boat
-				const auto boatBox = glm::vec4(-bTransform->scale, bTransform->scale);
-
-				// Get cannonball position relative to boat
-				const auto relativeBallPos = transform->position - bTransform->position;
-
-				// Convert into boat coordinate plane
-				const auto c              = cos(-bTransform->rotation);
-				const auto s              = sin(-bTransform->rotation);
-				const auto rotatedBallBox = glm::vec4(
-					glm::vec2(relativeBallPos.x * c - relativeBallPos.y * s,
-					          relativeBallPos.x * s + relativeBallPos.y * c) - transform->scale,
-					transform->scale);
-
-				// If cannonball doesn't collide with boat, move on
-				if ((rotatedBallBox.x < boatBox.x || rotatedBallBox.y < boatBox.y || rotatedBallBox.x >
-				     boatBox.x + boatBox.z || rotatedBallBox.y > boatBox.y + boatBox.w))
-				{
-					continue;
-				}
-
-				// Cannonballs shouldn't hit their mothership
-				if (cannonball->parentShip.getIdx() == bIdx && cannonball->parentShip.isValid())
-				{
-					continue;
-				}
+				commands.destroyEntity(ecs.getEntityByIdx(s.cannonballIdx));
+			}
+			continue;
+		}
 
-				// Destroy the cannonball
-				ecs.getEntityByIdx(cannonballIdx).destroy();
+		// Destroy the cannonball
+		commands.destroyEntity(ecs.getEntityByIdx(s.cannonballIdx));
 
-				// Create the explosion
-				auto explosionParticle = ecs.createEntity();
-				explosionParticle.setComponent<Transform>(
-					Transform(relativeBallPos + bTransform->position, 0, glm::vec2(60, 59)));
-				explosionParticle.setComponent<Sprite>(
-					Sprite(engine.getRenderer().getSpritesheet().getUv("explosion")));
-				explosionParticle.setComponent<Particle>(Particle(60, 60));
+		// Create the explosion where the cannonball hit
+		const auto explosionParticle = commands.createEntity();
+		commands.setComponent<Transform>(explosionParticle,
+			Transform(s.start + (s.end - s.start) * firstHit, 0, glm::vec2(60, 59)));
+		commands.setComponent<Sprite>(explosionParticle,
+			Sprite(engine.getRenderer().getSpritesheet().getUv("explosion")));
+		commands.setComponent<Particle>(explosionParticle, Particle(60, 60));
 
-				// Damage the ship and destroy it if need be
-				if (--boat->health <= 0)
-				{
-					ecs.getEntityByIdx(bIdx).destroy();
-				}
-			}
+		// Damage the ship and destroy it if need be
+		auto boatEntity = ecs.getEntityByIdx(hitBoat);
+		if (--boatEntity.getComponent<Boat>()->health <= 0)
+		{
+			commands.destroyEntity(boatEntity);
 		}
 	}
 }
@@ -1,13 +1,51 @@
 #pragma once
 #include "../system.h"
+#include "../components.h"
+#include "../spatial_index.h"
+#include "../sweep_batch.h"
+
+#include <vector>
 
 /**
  * \brief Manages physics
  */
-class PhysicsSystem final : public System
+class PhysicsSystem final : public SystemWithAccess<Reads<>, Writes<Transform, Boat, Cannonball>>
 {
 public:
 	void update(Engine& engine, EntityComponentSystem& ecs) override;
+
+	/**
+	 * \brief Sweep a cannonball along its path through a boat
+	 * \param start Position of the cannonball at the start of the path
+	 * \param end Position of the cannonball at the end of the path
+	 * \param ball_scale Scale of the cannonball
+	 * \param boat Transform of the boat
+	 * \return How far along the path the cannonball hits the boat, 0 if it starts inside, above 1 if it misses
+	 */
+	static float sweepCannonball(glm::vec2 start, glm::vec2 end, glm::vec2 ball_scale, const Transform& boat);
+
+	/**
+	 * \brief Rotation of a boat as SweepBatch takes it, the cosine and sine of minus the rotation
+	 */
+	static glm::vec2 getSweepRotation(float rotation);
 private:
-	static constexpr float CHUNK_SIZE = 1000.0f;
+	// A cannonball that may hit a boat or falls into the water this update
+	struct Shot final
+	{
+		uint32_t cannonballIdx;
+		uint32_t firstCandidate; // Its candidates run up to the next shot's first
+		glm::vec2 start;
+		glm::vec2 end;
+		bool fallsIntoWater;
+	};
+
+	// Boats that can be hit, binned again every update. Kept between updates so that steady state updates
+	// don't allocate
+	SpatialIndex m_boats;
+	std::vector<glm::vec2> m_boatRotations; // By entity index, see getSweepRotation
+
+	// The narrowphase, every candidate boat the broadphase found for the shots with the sweep of the same index
+	std::vector<Shot> m_shots;
+	std::vector<uint32_t> m_candidates;
+	SweepBatch m_sweeps;
 };
@@ -1,15 +1,28 @@
 #include "script_system.h"
 #include "../components.h"
 
+#include <algorithm>
+
 void ScriptSystem::update(Engine& engine, EntityComponentSystem& ecs)
 {
-	auto& sVec = ecs.getComponentVector<Script>();
+	// Scripts can do anything, including creating entities, so they run after the query
+	ecs.each<With<Script>>([&](uint32_t i)
+	{
+		m_scripted.push_back(i);
+	});
 
-	ecs.entityLoop([&](uint32_t i)
+	// Run scripts in entity order
+	std::sort(m_scripted.begin(), m_scripted.end());
+
+	for (const auto idx : m_scripted)
 	{
-		if (const auto script = static_cast<Script*>(sVec[i].get()))
+		auto entity = ecs.getEntityByIdx(idx);
+		if (const auto script = entity.getComponent<Script>())
 		{
-			script->script(engine, ecs.getEntityByIdx(i));
+			// Copy the script so it stays valid if the component storage changes while it runs
+			const auto func = script->script;
+			func(engine, entity);
 		}
-	});
+	}
+	m_scripted.clear();
 }
@@ -1,11 +1,17 @@
 #pragma once
 #include "../system.h"
+#include "../components.h"
+
+#include <cstdint>
+#include <vector>
 
 /**
- * \brief Runs scripts
+ * \brief Runs scripts, scripts can do anything so the system has exclusive access
  */
-class ScriptSystem final : public System
+class ScriptSystem final : public SystemWithAccess<Reads<>, Writes<AnyComponent>>
 {
 public:
 	void update(Engine& engine, EntityComponentSystem& ecs) override;
+private:
+	std::vector<uint32_t> m_scripted;
 };
@@ -2,42 +2,71 @@
 #include "../components.h"
 #include "../../engine.h"
 
+#include <algorithm>
+
 void SpriteRenderSystem::update(Engine& engine, EntityComponentSystem& ecs)
 {
 	auto& renderer = engine.getRenderer();
 
-	// Component vectors
-	auto& tVec = ecs.getComponentVector<Transform>();
-	auto& sVec = ecs.getComponentVector<Sprite>();
-
 	// Camera properties
-	const auto camT = engine.getRenderer().getCamera().getComponent<Transform>();
-	const auto ortho = engine.getRenderer().getCamera().getComponent<Camera>()->ortho;
+	const auto camT = engine.getRenderer().getCamera().getComponent<const Transform>();
+	const auto cam = engine.getRenderer().getCamera().getComponent<const Camera>();
+	if (!camT || !cam)
+	{
+		// Nothing can be seen without a camera, the renderer warns about it
+		return;
+	}
+	const auto ortho = cam->ortho;
 	const auto camPos = camT->position;
 	const auto camScale = camT->scale;
 
 	// Camera AABB
 	const auto camBox = glm::vec4(camPos - ortho / 2.0f / camScale, camPos + ortho / 2.0f / camScale);
 
-	ecs.entityLoop([&](uint32_t i)
+	// Check if sprite is in camera view w/ AABB check
+	const auto isVisible = [camBox](const Transform& transform)
 	{
-		const auto transform = static_cast<Transform*>(tVec[i].get());
-		const auto sprite = static_cast<Sprite*>(sVec[i].get());
+		// Get sprite AABB
+		const auto spriteBox = glm::vec4(transform.position - transform.scale,
+			transform.position + transform.scale);
 
-		// Entity needs transform and sprite component to be drawn
-		if (transform && sprite)
+		return !(spriteBox.z < camBox.x || spriteBox.w < camBox.y || spriteBox.x > camBox.z
+			|| spriteBox.y > camBox.w);
+	};
+
+	// Recompute the vertices of sprites that were added, moved or changed since the last frame. This only saves
+	// work when most sprites stand still, in a battle where every boat and cannonball moves each frame it
+	// computes about as many vertices as drawing them directly would
+	m_vertices.resize(ecs.getNumEntities());
+	const auto updateVertices = [&](uint32_t i, const Transform& transform, const Sprite& sprite)
+	{
+		m_vertices[i] = Spritebatch::getSpriteVertices(transform, sprite);
+	};
+	ecs.parallelEach<Changed<Transform>, const Transform, const Sprite>(updateVertices);
+	ecs.parallelEach<Changed<Sprite>, const Transform, const Sprite>(updateVertices);
+
+	// Entity needs transform and sprite component to be drawn. The spatial index finds the entities near the
+	// camera, sorting them keeps the sprites in the same order every frame
+	m_visible.clear();
+	ecs.getSpatialIndex().queryAabb(glm::vec2(camBox.x, camBox.y), glm::vec2(camBox.z, camBox.w),
+		[&](uint32_t i)
+		{
+			m_visible.push_back(i);
+		},
+		[&](uint32_t i)
 		{
-			// Get sprite AABB
-			const auto spriteBox = glm::vec4(transform->position - transform->scale,
-				transform->position + transform->scale);
-
-			// Check if sprite is in camera view w/ AABB check
-			if (!(spriteBox.z < camBox.x || spriteBox.w < camBox.y || spriteBox.x > camBox.z
-				|| spriteBox.y > camBox.w))
-			{
-				// Add sprite to spritebatch
-				renderer.getSpritebatch().addSprite(*transform, *sprite);
-			}
-		}
-	});
+			auto entity           = ecs.getEntityByIdx(i);
+			const auto* transform = entity.getComponent<const Transform>();
+			return transform && entity.getComponent<const Sprite>() && isVisible(*transform);
+		});
+	std::sort(m_visible.begin(), m_visible.end());
+
+	// Add sprites to spritebatch
+	auto& spritebatch = renderer.getSpritebatch();
+	const auto first  = spritebatch.addSprites(static_cast<uint32_t>(m_visible.size()));
+	for (uint32_t n = 0; n < m_visible.size(); ++n)
+	{
+		const auto i = m_visible[n];
+		spritebatch.setSprite(first + n, m_vertices[i], ecs.getEntityByIdx(i).getComponent<const Sprite>()->depth);
+	}
 }
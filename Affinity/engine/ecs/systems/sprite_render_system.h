@@ -1,8 +1,20 @@
 ﻿#pragma once
 #include "../system.h"
+#include "../components.h"
+#include "../../graphical/spritebatch.h"
 
-class SpriteRenderSystem final : public System
+#include <array>
+#include <cstdint>
+#include <vector>
+
+class SpriteRenderSystem final : public SystemWithAccess<Reads<Transform, Sprite, Camera>, Writes<>>
 {
 public:
 	void update(Engine& engine, EntityComponentSystem& ecs) override;
+private:
+	// Entities found by the culling query, kept to reuse its memory
+	std::vector<uint32_t> m_visible;
+
+	// Vertices of every entity's sprite, indexed by entity. Only recomputed when the transform or sprite changed
+	std::vector<std::array<Vertex, 4>> m_vertices;
 };
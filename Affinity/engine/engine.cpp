@@ -160,19 +160,23 @@ void Engine::initEcs()
 	LOG_VERBOSE << "Initializing ECS";
 	m_ecs = std::make_unique<EntityComponentSystem>();
 
-	// Register components
-	m_ecs->registerComponent<Transform>();
+	// Register components. Transforms are packed so the boats' components can be grouped
+	m_ecs->registerComponent<Transform>(ComponentStorageEnum::SPARSE_SET);
 	m_ecs->registerComponent<Sprite>();
-	m_ecs->registerComponent<Camera>();
-	m_ecs->registerComponent<Script>();
-	m_ecs->registerComponent<Boat>();
-	m_ecs->registerComponent<BoatAi>();
-	m_ecs->registerComponent<Cannonball>();
-	m_ecs->registerComponent<Particle>();
-
-	// Add systems
-	m_ecs->addSystem<BoatSystem>();
+	m_ecs->registerComponent<Camera>(ComponentStorageEnum::SPARSE_SET);
+	m_ecs->registerComponent<Script>(ComponentStorageEnum::SPARSE_SET);
+	m_ecs->registerComponent<Boat>(ComponentStorageEnum::SPARSE_SET);
+	m_ecs->registerComponent<BoatAi>(ComponentStorageEnum::SPARSE_SET);
+	m_ecs->registerComponent<Cannonball>(ComponentStorageEnum::SPARSE_SET);
+	m_ecs->registerComponent<Particle>(ComponentStorageEnum::SPARSE_SET);
+
+	// BoatSystem walks the boats every frame
+	m_ecs->addGroup<Transform, Boat, BoatAi>();
+
+	// Add systems, systems that don't access the same components may update at the same time
+	// (i.e. particles alongside boats), scripts can do anything so they run alone first
 	m_ecs->addSystem<ScriptSystem>();
+	m_ecs->addSystem<BoatSystem>();
 	m_ecs->addSystem<PhysicsSystem>();
 	m_ecs->addSystem<ParticleSystem>();
 	m_ecs->addSystem<SpriteRenderSystem>();
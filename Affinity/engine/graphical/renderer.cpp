@@ -42,11 +42,23 @@ Renderer::~Renderer()
 
 void Renderer::render()
 {
+	// The camera may have been destroyed since it was set
+	const auto cameraTransform = m_activeCamera.getComponent<const Transform>();
+	const auto camera          = m_activeCamera.getComponent<const Camera>();
+	if (!cameraTransform || !camera)
+	{
+		// todo: find alternative to spamming "No active camera"
+		LOG_WARNING << "No active camera";
+		drawGui();
+		m_spritebatch.clear();
+		return;
+	}
+
 	m_worldShader.bind();
 
 	m_worldShader.setVec4("uv", m_spritesheet.getUv("water"));
-	m_worldShader.setVec2("cameraPos", m_activeCamera.getComponent<Transform>()->position);
-	m_worldShader.setVec2("cameraScale", m_activeCamera.getComponent<Transform>()->scale);
+	m_worldShader.setVec2("cameraPos", cameraTransform->position);
+	m_worldShader.setVec2("cameraScale", cameraTransform->scale);
 	m_worldShader.setVec2("screenResolution", m_engine.getWindow().getResolution());
 
 	// Draw fullscreen quad
@@ -78,28 +90,20 @@ void Renderer::render()
 
 	m_spriteShader.bind();
 
-	if (m_activeCamera.isValid())
-	{
-		const auto ortho = m_activeCamera.getComponent<Camera>()->ortho;
+	const auto ortho = camera->ortho;
 
-		const auto orthoMatrix = glm::ortho(0.0f, ortho.x, 0.0f, ortho.y);
+	const auto orthoMatrix = glm::ortho(0.0f, ortho.x, 0.0f, ortho.y);
 
-		const auto pos   = m_activeCamera.getComponent<Transform>()->position;
-		const auto scale = m_activeCamera.getComponent<Transform>()->scale;
+	const auto pos   = cameraTransform->position;
+	const auto scale = cameraTransform->scale;
 
-		m_spriteShader.setMat4("cameraMatrix",
-		                       glm::translate(
-			                       glm::scale(orthoMatrix, glm::vec3(scale, 1.0f)),
-			                       -glm::vec3(pos - ortho / 2.0f / scale, 0.0f)
-		                       ));
+	m_spriteShader.setMat4("cameraMatrix",
+	                       glm::translate(
+		                       glm::scale(orthoMatrix, glm::vec3(scale, 1.0f)),
+		                       -glm::vec3(pos - ortho / 2.0f / scale, 0.0f)
+	                       ));
 
-		m_spritebatch.draw();
-	}
-	else
-	{
-		// todo: find alternative to spamming "No active camera"
-		LOG_WARNING << "No active camera";
-	}
+	m_spritebatch.draw();
 
 	drawGui();
 
@@ -109,8 +113,8 @@ void Renderer::render()
 void Renderer::setCamera(Entity entity)
 {
 	if (!entity.isValid()
-	    || !entity.getComponent<Transform>()
-	    || !entity.getComponent<Camera>())
+	    || !entity.getComponent<const Transform>()
+	    || !entity.getComponent<const Camera>())
 	{
 		LOG_WARNING << "Invalid camera";
 		return;
@@ -157,6 +161,12 @@ void Renderer::drawGui()
 	ImGui::Text("Entities:  %d/%d", m_engine.getEntityComponentSystem().getNumActiveEntities(),
 	            m_engine.getEntityComponentSystem().getNumEntities());
 	ImGui::Text("Sprites:   %d", m_spritebatch.getNumSprites());
+	if (ImGui::Button("Compact entities"))
+	{
+		// Compaction moves the camera to another index, so the handle has to follow it
+		const auto remap = m_engine.getEntityComponentSystem().compact();
+		setCamera(remap.apply(m_activeCamera));
+	}
 	ImGui::End();
 
 	// Draw it
@@ -37,6 +37,28 @@ Spritebatch::~Spritebatch()
 }
 
 void Spritebatch::addSprite(const Transform& transform, const Sprite& sprite)
+{
+	setSprite(addSprites(1), transform, sprite);
+}
+
+uint32_t Spritebatch::addSprites(uint32_t count)
+{
+	const auto first = static_cast<uint32_t>(m_sprites.size());
+	m_sprites.resize(m_sprites.size() + count);
+	return first;
+}
+
+void Spritebatch::setSprite(uint32_t sprite_index, const Transform& transform, const Sprite& sprite)
+{
+	setSprite(sprite_index, getSpriteVertices(transform, sprite), sprite.depth);
+}
+
+void Spritebatch::setSprite(uint32_t sprite_index, const std::array<Vertex, 4>& vertices, double depth)
+{
+	m_sprites[sprite_index] = std::make_pair(vertices, depth);
+}
+
+std::array<Vertex, 4> Spritebatch::getSpriteVertices(const Transform& transform, const Sprite& sprite)
 {
 	auto modelMatrix = glm::mat4(1);
 	modelMatrix      = glm::translate(modelMatrix, glm::vec3(transform.position, 0.0f));
@@ -73,7 +95,7 @@ void Spritebatch::addSprite(const Transform& transform, const Sprite& sprite)
 		sprite.color
 	});
 
-	m_sprites.emplace_back(std::array<Vertex, 4>({bl, br, tr, tl}), sprite.depth);
+	return {bl, br, tr, tl};
 }
 
 void Spritebatch::draw()
@@ -38,6 +38,38 @@ public:
 	 */
 	void addSprite(const Transform& transform, const Sprite& sprite);
 
+	/**
+	 * \brief Make room for sprites that are filled in later with setSprite, so several threads can
+	 * fill in different sprites at once
+	 * \param count Amount of sprites
+	 * \return Index of the first new sprite
+	 */
+	uint32_t addSprites(uint32_t count);
+
+	/**
+	 * \brief Fill in a sprite made room for with addSprites
+	 * \param sprite_index Index of the sprite
+	 * \param transform Transform component
+	 * \param sprite Sprite component
+	 */
+	void setSprite(uint32_t sprite_index, const Transform& transform, const Sprite& sprite);
+
+	/**
+	 * \brief Fill in a sprite made room for with addSprites from vertices computed earlier
+	 * \param sprite_index Index of the sprite
+	 * \param vertices Vertices from getSpriteVertices
+	 * \param depth Depth of the sprite
+	 */
+	void setSprite(uint32_t sprite_index, const std::array<Vertex, 4>& vertices, double depth);
+
+	/**
+	 * \brief Compute the vertices of a sprite, they stay the same until the transform or sprite changes
+	 * \param transform Transform component
+	 * \param sprite Sprite component
+	 * \return Bottom left, bottom right, top right and top left vertex
+	 */
+	static std::array<Vertex, 4> getSpriteVertices(const Transform& transform, const Sprite& sprite);
+
 	/**
 	 * \brief Draw all sprites added since last clear
 	 */
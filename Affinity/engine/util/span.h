@@ -0,0 +1,30 @@
+#pragma once
+#include <cstdint>
+
+/**
+ * \brief A non-owning view of a contiguous array
+ * \tparam T Element type
+ */
+template <typename T>
+class Span final
+{
+public:
+	Span() = default;
+
+	Span(T* data, uint32_t size)
+		: m_data(data), m_size(size)
+	{
+	}
+
+	T& operator[](uint32_t i) const { return m_data[i]; }
+
+	T* data() const { return m_data; }
+	uint32_t size() const { return m_size; }
+	bool empty() const { return m_size == 0; }
+
+	T* begin() const { return m_data; }
+	T* end() const { return m_data + m_size; }
+private:
+	T* m_data       = nullptr;
+	uint32_t m_size = 0;
+};
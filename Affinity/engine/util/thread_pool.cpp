@@ -0,0 +1,193 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+namespace
+{
+	thread_local uint32_t threadIndex = 0;
+
+	// Set while the thread is running items, nested loops run inline instead of deadlocking
+	thread_local bool insideLoop = false;
+
+	uint64_t packRange(uint64_t begin, uint64_t end)
+	{
+		return begin | end << 32;
+	}
+}
+
+ThreadPool::ThreadPool(uint32_t num_threads)
+	: m_numThreads(std::max(1u, num_threads)), m_ranges(std::make_unique<WorkRange[]>(m_numThreads))
+{
+	m_workers.reserve(m_numThreads - 1);
+	for (uint32_t i = 1; i < m_numThreads; ++i)
+	{
+		m_workers.emplace_back(&ThreadPool::workerLoop, this, i);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopping = true;
+	}
+	m_wakeCondition.notify_all();
+
+	for (auto& worker : m_workers)
+	{
+		worker.join();
+	}
+}
+
+uint32_t ThreadPool::getNumThreads() const
+{
+	return m_numThreads;
+}
+
+uint32_t ThreadPool::getThreadIndex()
+{
+	return threadIndex;
+}
+
+bool ThreadPool::shouldDispatch(uint32_t num_items) const
+{
+	return num_items > 1 && m_numThreads > 1 && !insideLoop;
+}
+
+bool ThreadPool::dispatch(uint32_t num_items, InvokeFunc invoke, void* context)
+{
+	// Systems running at the same time may both start loops, the workers are busy with the first one
+	std::unique_lock<std::mutex> dispatchLock(m_dispatchMutex, std::try_to_lock);
+	if (!dispatchLock)
+	{
+		return false;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		// A worker that woke up late for the previous loop may still be looking for items
+		while (m_active.load(std::memory_order_acquire) != 0)
+		{
+			std::this_thread::yield();
+		}
+
+		for (uint32_t i = 0; i < m_numThreads; ++i)
+		{
+			const auto begin = static_cast<uint64_t>(num_items) * i / m_numThreads;
+			const auto end   = static_cast<uint64_t>(num_items) * (i + 1) / m_numThreads;
+			m_ranges[i].range.store(packRange(begin, end), std::memory_order_relaxed);
+		}
+
+		m_remaining.store(num_items, std::memory_order_relaxed);
+		m_invoke  = invoke;
+		m_context = context;
+		++m_generation;
+	}
+	m_wakeCondition.notify_all();
+
+	insideLoop = true;
+	runItems(0, invoke, context);
+
+	// Wait for the items other threads are still running
+	while (m_remaining.load(std::memory_order_acquire) != 0)
+	{
+		std::this_thread::yield();
+	}
+	insideLoop = false;
+	return true;
+}
+
+void ThreadPool::workerLoop(uint32_t thread_index)
+{
+	threadIndex = thread_index;
+	insideLoop  = true;
+
+	uint64_t generation = 0;
+	while (true)
+	{
+		InvokeFunc invoke;
+		void* context;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_wakeCondition.wait(lock, [&] { return m_stopping || m_generation != generation; });
+			if (m_stopping)
+			{
+				return;
+			}
+
+			generation = m_generation;
+			invoke     = m_invoke;
+			context    = m_context;
+			m_active.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		runItems(thread_index, invoke, context);
+		m_active.fetch_sub(1, std::memory_order_release);
+	}
+}
+
+void ThreadPool::runItems(uint32_t thread_index, InvokeFunc invoke, void* context)
+{
+	uint32_t item;
+
+	// Own range front to back first, neighbouring items are likely to share cache lines
+	while (popItem(thread_index, item))
+	{
+		invoke(context, item);
+		m_remaining.fetch_sub(1, std::memory_order_acq_rel);
+	}
+
+	// Then steal from the back of the other ranges, away from where their owners are working
+	for (uint32_t i = 1; i < m_numThreads; ++i)
+	{
+		const auto victim = (thread_index + i) % m_numThreads;
+		while (stealItem(victim, item))
+		{
+			invoke(context, item);
+			m_remaining.fetch_sub(1, std::memory_order_acq_rel);
+		}
+	}
+}
+
+bool ThreadPool::popItem(uint32_t thread_index, uint32_t& item)
+{
+	auto& range  = m_ranges[thread_index].range;
+	auto current = range.load(std::memory_order_relaxed);
+	while (true)
+	{
+		const auto begin = current & 0xFFFFFFFF;
+		const auto end   = current >> 32;
+		if (begin >= end)
+		{
+			return false;
+		}
+
+		if (range.compare_exchange_weak(current, packRange(begin + 1, end), std::memory_order_acquire))
+		{
+			item = static_cast<uint32_t>(begin);
+			return true;
+		}
+	}
+}
+
+bool ThreadPool::stealItem(uint32_t victim, uint32_t& item)
+{
+	auto& range  = m_ranges[victim].range;
+	auto current = range.load(std::memory_order_relaxed);
+	while (true)
+	{
+		const auto begin = current & 0xFFFFFFFF;
+		const auto end   = current >> 32;
+		if (begin >= end)
+		{
+			return false;
+		}
+
+		if (range.compare_exchange_weak(current, packRange(begin, end - 1), std::memory_order_acquire))
+		{
+			item = static_cast<uint32_t>(end - 1);
+			return true;
+		}
+	}
+}
@@ -0,0 +1,117 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/**
+ * \brief Pads a value to its own cache line so threads writing neighbouring values don't false share
+ * \tparam T Value type
+ */
+template <typename T>
+struct alignas(64) CacheLinePadded final
+{
+	T value;
+};
+
+/**
+ * \brief Persistent worker threads for data parallel loops. Every loop is split into items, each thread
+ * starts on its own contiguous range of items and steals from the back of the other ranges once it
+ * runs out, so uneven items still keep every thread busy.
+ *
+ * Loops started from inside a loop, or while another thread's loop is running, run on the calling thread
+ */
+class ThreadPool final
+{
+public:
+	/**
+	 * \param num_threads Amount of threads including the thread starting loops
+	 */
+	explicit ThreadPool(uint32_t num_threads = std::thread::hardware_concurrency());
+	~ThreadPool();
+	ThreadPool(const ThreadPool& other) = delete;
+	ThreadPool(ThreadPool&& other) noexcept = delete;
+	ThreadPool& operator=(const ThreadPool& other) = delete;
+	ThreadPool& operator=(ThreadPool&& other) noexcept = delete;
+
+	/**
+	 * \brief Call a function for every item and wait for all of them to finish. Items may run in any
+	 * order on any thread
+	 * \param num_items Amount of items
+	 * \param func Function taking the item index
+	 */
+	template <typename Func>
+	void parallelFor(uint32_t num_items, Func&& func);
+
+	/**
+	 * \brief Get the amount of threads including the thread starting loops
+	 */
+	uint32_t getNumThreads() const;
+
+	/**
+	 * \brief Get the index of the current thread, 0 for the thread starting loops and 1 and up for workers
+	 */
+	static uint32_t getThreadIndex();
+private:
+	using InvokeFunc = void (*)(void* context, uint32_t item);
+
+	// Each thread's remaining items, begin in the low and end in the high 32 bits
+	struct alignas(64) WorkRange final
+	{
+		std::atomic<uint64_t> range{0};
+	};
+
+	bool shouldDispatch(uint32_t num_items) const;
+
+	/**
+	 * \brief Run a loop on every thread
+	 * \return False if another thread's loop is running, nothing was run
+	 */
+	bool dispatch(uint32_t num_items, InvokeFunc invoke, void* context);
+	void workerLoop(uint32_t thread_index);
+	void runItems(uint32_t thread_index, InvokeFunc invoke, void* context);
+
+	bool popItem(uint32_t thread_index, uint32_t& item);
+	bool stealItem(uint32_t victim, uint32_t& item);
+
+	uint32_t m_numThreads;
+	std::unique_ptr<WorkRange[]> m_ranges;
+	std::vector<std::thread> m_workers;
+
+	// Held by the thread running a loop
+	std::mutex m_dispatchMutex;
+
+	// Guards starting a loop and workers picking it up
+	std::mutex m_mutex;
+	std::condition_variable m_wakeCondition;
+	uint64_t m_generation = 0;
+	bool m_stopping       = false;
+	InvokeFunc m_invoke   = nullptr;
+	void* m_context       = nullptr;
+
+	alignas(64) std::atomic<uint32_t> m_remaining{0};
+	alignas(64) std::atomic<uint32_t> m_active{0};
+};
+
+template <typename Func>
+void ThreadPool::parallelFor(uint32_t num_items, Func&& func)
+{
+	using FuncType = std::remove_reference_t<Func>;
+
+	const auto dispatched = shouldDispatch(num_items) && dispatch(num_items, [](void* context, uint32_t item)
+	{
+		(*static_cast<FuncType*>(context))(item);
+	}, const_cast<void*>(static_cast<const void*>(&func)));
+
+	if (!dispatched)
+	{
+		for (uint32_t i = 0; i < num_items; ++i)
+		{
+			func(i);
+		}
+	}
+}
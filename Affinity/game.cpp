@@ -1,5 +1,6 @@
 #include "game.h"
 #include "engine/ecs/components.h"
+#include "engine/ecs/prefab.h"
 #include "engine/config.h"
 
 int Game::run()
@@ -31,7 +32,7 @@ void Game::init()
 	{
 		auto t = entity.getComponent<Transform>();
 
-		const auto playerSpeed = entity.getComponent<Boat>()->maxSpeed;
+		const auto playerSpeed = entity.getComponent<const Boat>()->maxSpeed;
 		const auto playerT = entity.getComponent<Transform>();
 		auto& input = engine.getInput();
 		if (input.isKeyDown(config::TURN_RIGHT))
@@ -56,7 +57,7 @@ void Game::init()
 	camera.setComponent<Transform>();
 	camera.setComponent<Camera>();
 	camera.setComponent<Script>(Script(
-		[](Engine& engine, Entity entity)
+		[playerTag = ecs.internTag("player"), boatTag = ecs.internTag("boat")](Engine& engine, Entity entity)
 	{
 		auto& input = engine.getInput();
 		auto t = entity.getComponent<Transform>();
@@ -73,20 +74,14 @@ void Game::init()
 
 		// Elastic follow
 		glm::vec2 targetPosition;
-		const auto players = engine.getEntityComponentSystem().findEntitiesWithTag("player");
-		if (!players.empty())
+		auto target = engine.getEntityComponentSystem().findEntityWithTag(playerTag);
+		if (!target.isValid())
 		{
-			auto player = players[0];
-			targetPosition = player.getComponent<Transform>()->position;
+			target = engine.getEntityComponentSystem().findEntityWithTag(boatTag);
 		}
-		else
+		if (target.isValid())
 		{
-			const auto boats = engine.getEntityComponentSystem().findEntitiesWithTag("boat");
-			if (!boats.empty())
-			{
-				auto boat = boats[0];
-				targetPosition = boat.getComponent<Transform>()->position;
-			}
+			targetPosition = target.getComponent<const Transform>()->position;
 		}
 
 		const auto stiffness = 1.0f / 10.0f;
@@ -99,18 +94,26 @@ void Game::init()
 	// Create boats
 	constexpr auto numEntities = 10000;
 	const auto sideLength = static_cast<int>(ceil(numEntities / 5.0f));
+	const auto boatTag = ecs.internTag("boat");
 
-	for (auto i = 0; i < numEntities; ++i)
+	// Half of the boats on each team, created in one batch per team and then scattered
+	std::vector<Entity> boats;
+	for (auto i = 0; i < 2; ++i)
 	{
-		const auto team = static_cast<Boat::BoatTeamEnum>(i % 2 + 1);
+		const auto team = static_cast<Boat::BoatTeamEnum>(i + 1);
+
+		Prefab boat;
+		boat.setTag(boatTag)
+		    .setComponent<Transform>(Transform(glm::vec2(0), 0, config::BOAT_SIZE))
+		    .setComponent<Sprite>(
+			    Sprite(renderer.getSpritesheet().getUv("ship_" + std::to_string(static_cast<int>(team)))))
+		    .setComponent<Boat>(Boat(team))
+		    .setComponent<BoatAi>();
 
-		auto e = ecs.createEntity();
-		e.setTag("boat");
-		e.setComponent<Transform>(Transform(glm::vec2(rand() % sideLength, rand() % sideLength) * 10.0f, 0,
-			config::BOAT_SIZE));
-		e.setComponent<Sprite>(
-			Sprite(renderer.getSpritesheet().getUv("ship_" + std::to_string(static_cast<int>(team)))));
-		e.setComponent<Boat>(Boat(team));
-		e.setComponent<BoatAi>();
+		ecs.createEntities(numEntities / 2, boat, boats);
+		for (auto& e : boats)
+		{
+			e.getComponent<Transform>()->position = glm::vec2(rand() % sideLength, rand() % sideLength) * 10.0f;
+		}
 	}
 }
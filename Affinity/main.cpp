@@ -1,6 +1,15 @@
 #include "game.h"
+#include "benchmark/benchmark.h"
+
+#include <string>
 
 int main(int argc, char* argv[])
 {
+	// Headless benchmarks, no window is opened
+	if (argc > 1 && std::string(argv[1]) == "--benchmark")
+	{
+		return benchmark::run();
+	}
+
 	return Game().run();
 }